@@ -7,18 +7,24 @@
 
 #include "interval.h"
 
-class aabb {
+template <typename T>
+class basic_aabb {
   public:
+    using interval = basic_interval<T>;
+    using point3 = basic_vec3<T>;
+    using vec3 = basic_vec3<T>;
+    using ray = basic_ray<T>;
+
     interval x,y,z;
 
-    aabb() {} // The default AABB is empty, since intervals are empty by default.
+    constexpr basic_aabb() {} // The default AABB is empty, since intervals are empty by default.
 
-    aabb(const interval& x, const interval& y, const interval& z)
+    constexpr basic_aabb(const interval& x, const interval& y, const interval& z)
       : x(x), y(y), z(z) {
       pad_to_minimums();
     }
 
-    aabb(const point3& a, const point3& b) {
+    basic_aabb(const point3& a, const point3& b) {
       // Treat the two points a and b as extrema for the bounding box, so we don't rquire a
       // particular minimum/maximum coordinate order.
 
@@ -29,11 +35,8 @@ class aabb {
       pad_to_minimums();
     }
 
-  aabb(const aabb& box0, const aabb& box1) {
-      x = interval(box0.x, box1.x);
-      y = interval(box0.y, box1.y);
-      z = interval(box0.z, box1.z);
-    }
+  constexpr basic_aabb(const basic_aabb& box0, const basic_aabb& box1)
+      : x(box0.x, box1.x), y(box0.y, box1.y), z(box0.z, box1.z) {}
 
     const interval& axis_interval(int n) const {
       if (n == 1) return y;
@@ -42,30 +45,16 @@ class aabb {
     }
 
     bool hit(const ray& r, interval ray_t) const {
+      // Branchless slab test. The ray's direction sign picks which plane of each slab is
+      // entered first, so there is no per-axis division, compare-and-swap or early exit.
       const point3& ray_orig = r.origin();
-      const vec3& ray_dir = r.direction();
-
-      for (int axis = 0; axis < 3; axis++) {
-        const interval& ax = axis_interval(axis);
-        const double adinv = 1.0 / ray_dir[axis];
-
-        auto t0 = (ax.min - ray_orig[axis]) * adinv;
-        auto t1 = (ax.max - ray_orig[axis]) * adinv;
-
-        if (t0 < t1) {
-          if (t0 > ray_t.min) ray_t.min = t0;
-          if (t1 < ray_t.max) ray_t.max = t1;
-        } else {
-          if (t1 > ray_t.min) ray_t.min = t1;
-          if (t0 < ray_t.max) ray_t.max = t0;
-        }
+      const vec3& inv_dir = r.inv_direction();
 
-        if (ray_t.max <= ray_t.min)
-          return false;
-      }
-
-      return true;
+      clip_slab(x, ray_orig.x(), inv_dir.x(), r.dir_is_neg(0), ray_t);
+      clip_slab(y, ray_orig.y(), inv_dir.y(), r.dir_is_neg(1), ray_t);
+      clip_slab(z, ray_orig.z(), inv_dir.z(), r.dir_is_neg(2), ray_t);
 
+      return ray_t.min < ray_t.max;
     }
 
     int longest_axis() const {
@@ -78,13 +67,21 @@ class aabb {
 
     }
 
-    static const aabb empty, universe;
+    static const basic_aabb empty, universe;   // Constant initialized; see interval.h
 
 private:
-  void pad_to_minimums() {
+  static void clip_slab(const interval& ax, T orig, T inv_dir, bool neg,
+                        interval& ray_t) {
+    auto t_near = ((neg ? ax.max : ax.min) - orig) * inv_dir;
+    auto t_far = ((neg ? ax.min : ax.max) - orig) * inv_dir;
+    ray_t.min = t_near > ray_t.min ? t_near : ray_t.min;
+    ray_t.max = t_far < ray_t.max ? t_far : ray_t.max;
+  }
+
+  constexpr void pad_to_minimums() {
     // adjust the aabb so that no side is narrower than some delta, padding if necessary
 
-    double delta = 0.0001;
+    T delta = T(0.0001);
     if (x.size() < delta) x = x.expand(delta);
     if (y.size() < delta) y = y.expand(delta);
     if (z.size() < delta) z = z.expand(delta);
@@ -92,14 +89,22 @@ private:
 
 };
 
-const aabb aabb::empty = aabb(interval::empty, interval::empty, interval::empty);
-const aabb aabb::universe = aabb(interval::universe, interval::universe, interval::universe);
+template <typename T>
+constexpr basic_aabb<T> basic_aabb<T>::empty =
+    basic_aabb<T>(basic_interval<T>::empty, basic_interval<T>::empty, basic_interval<T>::empty);
+template <typename T>
+constexpr basic_aabb<T> basic_aabb<T>::universe =
+    basic_aabb<T>(basic_interval<T>::universe, basic_interval<T>::universe, basic_interval<T>::universe);
+
+using aabb = basic_aabb<real>;
 
-aabb operator+(const aabb& bbox, const vec3& offset) {
-  return aabb(bbox.x + offset.x(), bbox.y + offset.y(), bbox.z + offset.z());
+template <typename T>
+basic_aabb<T> operator+(const basic_aabb<T>& bbox, const basic_vec3<T>& offset) {
+  return basic_aabb<T>(bbox.x + offset.x(), bbox.y + offset.y(), bbox.z + offset.z());
 }
 
-aabb operator+(const vec3& offset, const aabb& bbox) {
+template <typename T>
+basic_aabb<T> operator+(const basic_vec3<T>& offset, const basic_aabb<T>& bbox) {
   return bbox + offset;
 }
 #endif //AABB_H
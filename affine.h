@@ -0,0 +1,144 @@
+#ifndef AFFINE_H
+#define AFFINE_H
+
+#include "aabb.h"
+#include "rtweekend.h"
+
+#include <algorithm>
+#include <cmath>
+#include <initializer_list>
+
+// A 3x4 affine transform: a 3x3 linear part and a translation, stored row by row. Points
+// map as p' = L p + t. Transforms compose like matrices, so (a * b) applies b first.
+
+class affine {
+  public:
+    double m[3][4];
+
+    affine() : affine(identity()) {}
+
+    static affine identity() {
+        return affine({ 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 });
+    }
+
+    static affine translation(const vec3& offset) {
+        return affine({ 1, 0, 0, offset.x() }, { 0, 1, 0, offset.y() }, { 0, 0, 1, offset.z() });
+    }
+
+    static affine scaling(const vec3& factors) {
+        return affine({ factors.x(), 0, 0, 0 }, { 0, factors.y(), 0, 0 }, { 0, 0, factors.z(), 0 });
+    }
+
+    static affine rotation(const vec3& axis, double degrees) {
+        // Counterclockwise about axis when looking down it toward the origin; about y this
+        // matches rotate_y.
+        auto a = unit_vector(axis);
+        auto radians = degrees_2_radians(degrees);
+        auto c = std::cos(radians), s = std::sin(radians), k = 1 - c;
+        auto x = a.x(), y = a.y(), z = a.z();
+        return affine({ c + x*x*k,   x*y*k - z*s, x*z*k + y*s, 0 },
+                      { y*x*k + z*s, c + y*y*k,   y*z*k - x*s, 0 },
+                      { z*x*k - y*s, z*y*k + x*s, c + z*z*k,   0 });
+    }
+
+    point3 point(const point3& p) const {
+        return point3(m[0][0]*p.x() + m[0][1]*p.y() + m[0][2]*p.z() + m[0][3],
+                      m[1][0]*p.x() + m[1][1]*p.y() + m[1][2]*p.z() + m[1][3],
+                      m[2][0]*p.x() + m[2][1]*p.y() + m[2][2]*p.z() + m[2][3]);
+    }
+
+    vec3 point_error(const point3& p) const {
+        // Per-axis bound on the rounding error of point(p): three roundings of the sum of
+        // its terms' magnitudes, and one more where the result is narrowed to real.
+        auto magnitude = [&](int i) {
+            return std::fabs(m[i][0]*p.x()) + std::fabs(m[i][1]*p.y())
+                 + std::fabs(m[i][2]*p.z()) + std::fabs(m[i][3]);
+        };
+        return rounding_gamma<real>(4) * vec3(magnitude(0), magnitude(1), magnitude(2));
+    }
+
+    vec3 vector(const vec3& v) const {
+        return vec3(m[0][0]*v.x() + m[0][1]*v.y() + m[0][2]*v.z(),
+                    m[1][0]*v.x() + m[1][1]*v.y() + m[1][2]*v.z(),
+                    m[2][0]*v.x() + m[2][1]*v.y() + m[2][2]*v.z());
+    }
+
+    vec3 transpose_vector(const vec3& v) const {
+        // Applies the transpose of the linear part. Called on the inverse of a transform,
+        // this maps surface normals through the transform.
+        return vec3(m[0][0]*v.x() + m[1][0]*v.y() + m[2][0]*v.z(),
+                    m[0][1]*v.x() + m[1][1]*v.y() + m[2][1]*v.z(),
+                    m[0][2]*v.x() + m[1][2]*v.y() + m[2][2]*v.z());
+    }
+
+    aabb box(const aabb& b) const {
+        // The exact bounds of the transformed box (Arvo's method): each output axis takes
+        // the smaller and larger product of every matrix entry with the input interval.
+        interval out[3];
+        for (int i = 0; i < 3; i++) {
+            double lo = m[i][3], hi = m[i][3];
+            for (int j = 0; j < 3; j++) {
+                if (m[i][j] == 0)
+                    continue;
+                const auto& in = b.axis_interval(j);
+                double a = m[i][j] * in.min, c = m[i][j] * in.max;
+                lo += std::fmin(a, c);
+                hi += std::fmax(a, c);
+            }
+            out[i] = interval(lo, hi);
+        }
+        return aabb(out[0], out[1], out[2]);
+    }
+
+    double determinant() const {
+        return m[0][0] * (m[1][1]*m[2][2] - m[1][2]*m[2][1])
+             - m[0][1] * (m[1][0]*m[2][2] - m[1][2]*m[2][0])
+             + m[0][2] * (m[1][0]*m[2][1] - m[1][1]*m[2][0]);
+    }
+
+    bool invertible() const {
+        return std::isfinite(1.0 / determinant());
+    }
+
+    affine inverse() const {
+        // Inverts the linear part by cofactors; the transform must be invertible.
+        auto inv_det = 1.0 / determinant();
+        affine r;
+        r.m[0][0] = (m[1][1]*m[2][2] - m[1][2]*m[2][1]) * inv_det;
+        r.m[0][1] = (m[0][2]*m[2][1] - m[0][1]*m[2][2]) * inv_det;
+        r.m[0][2] = (m[0][1]*m[1][2] - m[0][2]*m[1][1]) * inv_det;
+        r.m[1][0] = (m[1][2]*m[2][0] - m[1][0]*m[2][2]) * inv_det;
+        r.m[1][1] = (m[0][0]*m[2][2] - m[0][2]*m[2][0]) * inv_det;
+        r.m[1][2] = (m[0][2]*m[1][0] - m[0][0]*m[1][2]) * inv_det;
+        r.m[2][0] = (m[1][0]*m[2][1] - m[1][1]*m[2][0]) * inv_det;
+        r.m[2][1] = (m[0][1]*m[2][0] - m[0][0]*m[2][1]) * inv_det;
+        r.m[2][2] = (m[0][0]*m[1][1] - m[0][1]*m[1][0]) * inv_det;
+
+        auto t = r.vector(vec3(m[0][3], m[1][3], m[2][3]));
+        r.m[0][3] = -t.x();
+        r.m[1][3] = -t.y();
+        r.m[2][3] = -t.z();
+        return r;
+    }
+
+  private:
+    affine(std::initializer_list<double> r0, std::initializer_list<double> r1,
+           std::initializer_list<double> r2) {
+        std::copy(r0.begin(), r0.end(), m[0]);
+        std::copy(r1.begin(), r1.end(), m[1]);
+        std::copy(r2.begin(), r2.end(), m[2]);
+    }
+};
+
+inline affine operator*(const affine& a, const affine& b) {
+    affine r;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 4; j++) {
+            r.m[i][j] = a.m[i][0]*b.m[0][j] + a.m[i][1]*b.m[1][j] + a.m[i][2]*b.m[2][j];
+        }
+        r.m[i][3] += a.m[i][3];
+    }
+    return r;
+}
+
+#endif //AFFINE_H
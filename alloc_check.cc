@@ -0,0 +1,150 @@
+#include "rtweekend.h"
+
+#include "camera.h"
+#include "constant_medium.h"
+#include "hittable_list.h"
+#include "material.h"
+#include "quad.h"
+#include "sphere.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <streambuf>
+
+// Counts heap allocations made while rendering the same image at 1 and at 16 samples per
+// pixel. The path tracer should allocate nothing per sample, so both counts must match.
+
+static std::atomic<long> allocation_count(0);
+
+// With RT_SIMD_VEC3, types holding a vec3 are over-aligned, so they come through the
+// align_val_t overloads; both kinds are counted, and the array forms forward to them. The replacements are kept
+// out of line: once one is inlined into a caller, GCC sees malloc() paired with operator
+// delete, or free() with operator new, and warns (-Wmismatched-new-delete).
+#if defined(__GNUC__)
+#define ALLOC_CHECK_NOINLINE __attribute__((noinline))
+#else
+#define ALLOC_CHECK_NOINLINE
+#endif
+
+ALLOC_CHECK_NOINLINE void* operator new(std::size_t size) {
+    allocation_count++;
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+ALLOC_CHECK_NOINLINE void* operator new(std::size_t size, std::align_val_t alignment) {
+    allocation_count++;
+    // aligned_alloc wants a size that is a multiple of the alignment.
+    auto align = std::size_t(alignment);
+    auto rounded = (std::max<std::size_t>(size, 1) + align - 1) / align * align;
+    if (void* p = std::aligned_alloc(align, rounded))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) { return operator new(size); }
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return operator new(size, alignment);
+}
+
+ALLOC_CHECK_NOINLINE void operator delete(void* p) noexcept { std::free(p); }
+ALLOC_CHECK_NOINLINE void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+ALLOC_CHECK_NOINLINE void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+ALLOC_CHECK_NOINLINE void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept { operator delete(p); }
+void operator delete[](void* p, std::size_t) noexcept { operator delete(p); }
+void operator delete[](void* p, std::align_val_t alignment) noexcept {
+    operator delete(p, alignment);
+}
+void operator delete[](void* p, std::size_t, std::align_val_t alignment) noexcept {
+    operator delete(p, alignment);
+}
+
+class null_buffer : public std::streambuf {
+  protected:
+    int overflow(int c) override { return c; }
+};
+
+long count_render_allocations(camera& cam, const hittable& world, const hittable& lights) {
+    // Discard the image and progress output without buffering (and so allocating) it.
+    null_buffer sink;
+    auto cout_buf = std::cout.rdbuf(&sink);
+    auto clog_buf = std::clog.rdbuf(&sink);
+
+    auto before = allocation_count.load();
+    cam.render(world, lights);
+    auto after = allocation_count.load();
+
+    std::cout.rdbuf(cout_buf);
+    std::clog.rdbuf(clog_buf);
+    return after - before;
+}
+
+int main() {
+    // Cornell box with a glass sphere and a smoke-filled box, so every material and PDF
+    // type is exercised.
+    hittable_list world;
+
+    auto red = make_shared<lambertian>(color(.65, .05, .05));
+    auto white = make_shared<lambertian>(color(.73, .73, .73));
+    auto green = make_shared<lambertian>(color(.12, .45, .15));
+    auto light = make_shared<diffuse_light>(color(15, 15, 15));
+    auto aluminum = make_shared<metal>(color(0.8, 0.85, 0.88), 0.0);
+    auto glass = make_shared<dielectric>(1.5);
+
+    world.add(make_shared<quad>(point3(555,0,0), vec3(0,555,0), vec3(0,0,555), green));
+    world.add(make_shared<quad>(point3(0,0,0), vec3(0,555,0), vec3(0,0,555), red));
+    world.add(make_shared<quad>(point3(343,554,332), vec3(-130,0,0), vec3(0,0,-105), light));
+    world.add(make_shared<quad>(point3(0,0,0), vec3(555,0,0), vec3(0,0,555), white));
+    world.add(make_shared<quad>(point3(555,555,555), vec3(-555,0,0), vec3(0,0,-555), aluminum));
+    world.add(make_shared<quad>(point3(0,0,555), vec3(555,0,0), vec3(0,555,0), white));
+
+    shared_ptr<hittable> box1 = box(point3(0,0,0), point3(165,330,165), white);
+    box1 = make_shared<rotate_y>(box1, 15);
+    box1 = make_shared<translate>(box1, vec3(265,0,295));
+    world.add(make_shared<constant_medium>(box1, 0.01, color(0,0,0)));
+
+    world.add(make_shared<sphere>(point3(190,90,190), 90, glass));
+
+    auto empty_material = shared_ptr<material>();
+    hittable_list lights;
+    lights.add(make_shared<quad>(point3(343,554,332), vec3(-130,0,0), vec3(0,0,-105), empty_material));
+    lights.add(make_shared<sphere>(point3(190,90,190), 90, empty_material));
+
+    camera cam;
+    cam.aspect_ratio = 1.0;
+    cam.image_width = 32;
+    cam.max_depth = 10;
+    cam.background = color(0,0,0);
+    cam.vfov = 40;
+    cam.lookfrom = point3(278, 278, -800);
+    cam.lookat = point3(278, 278, 0);
+    cam.vup = vec3(0,1,0);
+    cam.output_file = "";
+
+    // The first render pays for one-off setup such as the OpenMP thread pool.
+    cam.samples_per_pixel = 1;
+    count_render_allocations(cam, world, lights);
+
+    auto one_spp = count_render_allocations(cam, world, lights);
+    cam.samples_per_pixel = 16;
+    auto many_spp = count_render_allocations(cam, world, lights);
+
+    std::cout << "Allocations at  1 spp: " << one_spp << '\n'
+              << "Allocations at 16 spp: " << many_spp << '\n';
+
+    if (many_spp != one_spp) {
+        std::cout << "FAIL: the path tracer allocates per sample\n";
+        return 1;
+    }
+
+    std::cout << "OK: no per-sample allocations\n";
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include "rtweekend.h"
+
+#include "aabb.h"
+#include "linear_bvh.h"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+// Micro-benchmark for ray/box slab tests: the original per-axis division loop against the
+// branchless test using the reciprocal direction and signs cached in the ray.
+
+bool legacy_hit(const aabb& box, const ray& r, interval ray_t) {
+    // aabb::hit as it was before rays cached their reciprocal direction.
+    const point3& ray_orig = r.origin();
+    const vec3& ray_dir = r.direction();
+
+    for (int axis = 0; axis < 3; axis++) {
+        const interval& ax = box.axis_interval(axis);
+        const double adinv = 1.0 / ray_dir[axis];
+
+        auto t0 = (ax.min - ray_orig[axis]) * adinv;
+        auto t1 = (ax.max - ray_orig[axis]) * adinv;
+
+        if (t0 < t1) {
+            if (t0 > ray_t.min) ray_t.min = t0;
+            if (t1 < ray_t.max) ray_t.max = t1;
+        } else {
+            if (t1 > ray_t.min) ray_t.min = t1;
+            if (t0 < ray_t.max) ray_t.max = t0;
+        }
+
+        if (ray_t.max <= ray_t.min)
+            return false;
+    }
+
+    return true;
+}
+
+template <typename Test>
+void run(const char* name, size_t tests, Test&& test) {
+    auto start = std::chrono::steady_clock::now();
+    auto hits = test();
+    auto end = std::chrono::steady_clock::now();
+
+    auto seconds = std::chrono::duration<double>(end - start).count();
+    std::cout << std::left << std::setw(22) << name
+              << std::setw(10) << tests / seconds / 1e6 << " M tests/s"
+              << "  (" << hits << " hits)\n";
+}
+
+int main() {
+    const int box_count = 1024;
+    const int ray_count = 4096;
+    const int repeats = 20;
+
+    std::vector<aabb> boxes;
+    std::vector<linear_bvh_node> nodes;
+    for (int i = 0; i < box_count; i++) {
+        auto p = point3::random(-10, 10);
+        boxes.push_back(aabb(p, p + vec3::random(0.1, 3)));
+
+        // Reuse the BVH builder's rounding by building a one-primitive tree per box.
+        std::vector<linear_bvh_node> single;
+        std::vector<uint32_t> order;
+        bvh_builder::build({ boxes.back() }, bvh_build_options{}, single, order);
+        nodes.push_back(single[0]);
+    }
+
+    std::vector<ray> rays;
+    for (int i = 0; i < ray_count; i++)
+        rays.push_back(ray(point3::random(-12, 12), random_unit_vector()));
+
+    const size_t tests = size_t(box_count) * ray_count * repeats;
+    const interval ray_t(0.001, infinity);
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << box_count << " boxes x " << ray_count << " rays x " << repeats << " repeats\n";
+
+    run("legacy aabb::hit", tests, [&] {
+        size_t hits = 0;
+        for (int n = 0; n < repeats; n++)
+            for (const auto& r : rays)
+                for (const auto& box : boxes)
+                    hits += legacy_hit(box, r, ray_t);
+        return hits;
+    });
+
+    run("aabb::hit", tests, [&] {
+        size_t hits = 0;
+        for (int n = 0; n < repeats; n++)
+            for (const auto& r : rays)
+                for (const auto& box : boxes)
+                    hits += box.hit(r, ray_t);
+        return hits;
+    });
+
+    run("linear_bvh_node::hit", tests, [&] {
+        size_t hits = 0;
+        for (int n = 0; n < repeats; n++)
+            for (const auto& r : rays)
+                for (const auto& node : nodes)
+                    hits += node.hit(r, ray_t);
+        return hits;
+    });
+}
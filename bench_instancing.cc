@@ -0,0 +1,143 @@
+#include "rtweekend.h"
+
+#include "instance_tlas.h"
+#include "material.h"
+#include "triangle_mesh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+// Places one torus mesh many times (default 10000 copies of 10000 triangles) with random
+// rotations, scales and offsets in an instance_tlas, then reports build time, memory and
+// ray throughput. A smaller scene is also flattened into one mesh of transformed copies to
+// check every instanced hit against it.
+
+triangle_mesh_data torus_mesh(long triangles) {
+    // Flat-shaded, so hits can be compared with transformed copies exactly.
+    int rings = std::max(3, int(std::sqrt(triangles / 2.0) * 2));
+    int sides = std::max(3, int(triangles / (2.0 * rings)));
+
+    triangle_mesh_data mesh;
+    for (int i = 0; i < rings; i++) {
+        double a = 2 * pi * i / rings;
+        for (int j = 0; j < sides; j++) {
+            double b = 2 * pi * j / sides;
+            double r = 1 + 0.3 * std::cos(b);
+            mesh.add_vertex(point3(r * std::cos(a), 0.3 * std::sin(b), r * std::sin(a)));
+        }
+    }
+    for (int i = 0; i < rings; i++) {
+        for (int j = 0; j < sides; j++) {
+            int next_i = (i + 1) % rings, next_j = (j + 1) % sides;
+            auto a = uint32_t(i * sides + j), b = uint32_t(i * sides + next_j);
+            auto c = uint32_t(next_i * sides + j), d = uint32_t(next_i * sides + next_j);
+            mesh.add_triangle(a, c, b);
+            mesh.add_triangle(b, c, d);
+        }
+    }
+    return mesh;
+}
+
+std::vector<affine> random_placements(int count, double extent) {
+    std::vector<affine> placements;
+    for (int k = 0; k < count; k++) {
+        auto axis = random_unit_vector();
+        auto scale = vec3(random_double(0.5, 1.5), random_double(0.5, 1.5), random_double(0.5, 1.5));
+        auto offset = extent * vec3(random_double(-1, 1), random_double(-1, 1), random_double(-1, 1));
+        placements.push_back(affine::translation(offset) * affine::rotation(axis, random_double(0, 360))
+                             * affine::scaling(scale));
+    }
+    return placements;
+}
+
+std::vector<ray> random_rays(int count, double extent) {
+    std::vector<ray> rays;
+    rays.reserve(count);
+    for (int k = 0; k < count; k++) {
+        auto origin = 2 * extent * random_unit_vector();
+        auto target = extent * vec3(random_double(-1, 1), random_double(-1, 1), random_double(-1, 1));
+        rays.emplace_back(origin, target - origin);
+    }
+    return rays;
+}
+
+int main(int argc, char* argv[]) {
+    long copies = argc > 1 ? std::atol(argv[1]) : 10000;
+    long triangles = argc > 2 ? std::atol(argv[2]) : 10000;
+    auto mat = shared_ptr<material>();
+
+    auto torus = make_shared<triangle_mesh>(torus_mesh(triangles), mat);
+    const double extent = 2 * std::cbrt(double(copies));
+
+    auto build_start = std::chrono::steady_clock::now();
+    instance_tlas scene;
+    for (const auto& placement : random_placements(int(copies), extent))
+        scene.add(torus, placement);
+    scene.build();
+    auto build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                                       - build_start).count();
+
+    double instanced_bytes = double(scene.memory_bytes() + torus->memory_bytes());
+    std::cout << copies << " instances of " << torus->triangle_count() << " triangles ("
+              << double(copies) * torus->triangle_count() << " in the scene)\n"
+              << "Top level built in " << build_seconds << " s; "
+              << instanced_bytes / (1024.0 * 1024.0) << " MiB in all, "
+              << double(scene.memory_bytes()) / copies << " bytes per instance; flattened copies "
+              << "would take about " << double(torus->memory_bytes()) * copies / (1024.0 * 1024.0)
+              << " MiB\n";
+
+    const int ray_count = 1000000;
+    auto rays = random_rays(ray_count, extent);
+    int hits = 0;
+    auto trace_start = std::chrono::steady_clock::now();
+    for (const auto& r : rays) {
+        hit_record rec;
+        if (scene.hit(r, interval(0.001, infinity), rec))
+            hits++;
+    }
+    auto trace_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                                       - trace_start).count();
+    std::cout << ray_count / trace_seconds / 1e6 << " M rays/s, " << hits << " hits\n";
+
+    // Check a small scene against the same copies transformed into one flat mesh.
+    const int check_copies = 64;
+    const double check_extent = 2 * std::cbrt(double(check_copies));
+    auto small = torus_mesh(2000);
+    auto small_torus = make_shared<triangle_mesh>(small, mat);
+    instance_tlas instanced;
+    triangle_mesh_data flat;
+    for (const auto& placement : random_placements(check_copies, check_extent)) {
+        instanced.add(small_torus, placement);
+        auto first = uint32_t(flat.vertex_count());
+        for (size_t v = 0; v < small.vertex_count(); v++) {
+            const float* p = &small.positions[3 * v];
+            flat.add_vertex(placement.point(point3(p[0], p[1], p[2])));
+        }
+        for (auto index : small.indices)
+            flat.indices.push_back(first + index);
+    }
+    instanced.build();
+    triangle_mesh reference(std::move(flat), mat);
+
+    int disagreements = 0;
+    double max_error = 0, max_normal_error = 0;
+    for (const auto& r : random_rays(200000, check_extent)) {
+        hit_record a, b;
+        bool hit_a = instanced.hit(r, interval(0.001, infinity), a);
+        bool hit_b = reference.hit(r, interval(0.001, infinity), b);
+        if (hit_a != hit_b) {
+            disagreements++;
+        } else if (hit_a) {
+            max_error = std::fmax(max_error, (a.p - b.p).length());
+            max_normal_error = std::fmax(max_normal_error, (a.normal - b.normal).length());
+        }
+    }
+    std::cout << disagreements << " of 200000 rays disagree with flattened copies (grazing "
+              << "edges); largest hit point distance " << max_error << ", normal difference "
+              << max_normal_error << "\n";
+    return 0;
+}
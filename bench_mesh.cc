@@ -0,0 +1,100 @@
+#include "rtweekend.h"
+
+#include "material.h"
+#include "sphere.h"
+#include "triangle_mesh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+// Tessellates the unit sphere into a triangle mesh with about the requested number of
+// triangles (default one million), then reports build time, memory per triangle, and ray
+// throughput, checking every hit against the analytic sphere.
+
+triangle_mesh_data unit_sphere_mesh(long triangles) {
+    // A latitude/longitude grid with shared vertices, normals and texture coordinates.
+    int stacks = std::max(2, int(std::sqrt(triangles / 4.0)));
+    int slices = std::max(3, int(triangles / (2.0 * stacks)));
+
+    triangle_mesh_data mesh;
+    mesh.positions.reserve(3 * size_t(stacks + 1) * (slices + 1));
+    for (int i = 0; i <= stacks; i++) {
+        double theta = pi * i / stacks;
+        for (int j = 0; j <= slices; j++) {
+            double phi = 2 * pi * j / slices;
+            point3 p(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+            mesh.add_vertex(p);
+            mesh.normals.insert(mesh.normals.end(), { float(p.x()), float(p.y()), float(p.z()) });
+            mesh.uvs.insert(mesh.uvs.end(), { float(j) / slices, float(i) / stacks });
+        }
+    }
+
+    mesh.indices.reserve(6 * size_t(stacks) * slices);
+    for (int i = 0; i < stacks; i++) {
+        for (int j = 0; j < slices; j++) {
+            uint32_t a = uint32_t(i * (slices + 1) + j), b = a + 1;
+            uint32_t c = a + uint32_t(slices + 1), d = c + 1;
+            mesh.add_triangle(a, c, b);
+            mesh.add_triangle(b, c, d);
+        }
+    }
+    return mesh;
+}
+
+int main(int argc, char* argv[]) {
+    long triangles = argc > 1 ? std::atol(argv[1]) : 1000000;
+    auto mat = shared_ptr<material>();
+
+    auto build_start = std::chrono::steady_clock::now();
+    auto data = unit_sphere_mesh(triangles);
+    triangle_mesh mesh(std::move(data), mat);
+    auto build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                                       - build_start).count();
+
+    std::cout << mesh.triangle_count() << " triangles, " << mesh.vertex_count() << " vertices\n"
+              << "Built in " << build_seconds << " s, "
+              << double(mesh.memory_bytes()) / mesh.triangle_count() << " bytes per triangle ("
+              << mesh.memory_bytes() / (1024.0 * 1024.0) << " MiB)\n";
+
+    // Rays from a shell around the sphere toward random points near its center.
+    sphere reference(point3(0, 0, 0), 1, mat);
+    const int ray_count = 1000000;
+    std::vector<ray> rays;
+    rays.reserve(ray_count);
+    for (int k = 0; k < ray_count; k++) {
+        auto origin = 3 * random_unit_vector();
+        auto target = 1.2 * vec3(random_double(-1, 1), random_double(-1, 1), random_double(-1, 1));
+        rays.emplace_back(origin, target - origin);
+    }
+
+    int hits = 0, disagreements = 0;
+    double max_error = 0;
+    auto trace_start = std::chrono::steady_clock::now();
+    for (const auto& r : rays) {
+        hit_record rec;
+        if (mesh.hit(r, interval(0.001, infinity), rec))
+            hits++;
+    }
+    auto trace_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                                       - trace_start).count();
+
+    for (const auto& r : rays) {
+        hit_record mesh_rec, sphere_rec;
+        bool mesh_hit = mesh.hit(r, interval(0.001, infinity), mesh_rec);
+        bool sphere_hit = reference.hit(r, interval(0.001, infinity), sphere_rec);
+        if (mesh_hit != sphere_hit) {
+            disagreements++;
+        } else if (mesh_hit) {
+            max_error = std::fmax(max_error, (mesh_rec.p - sphere_rec.p).length());
+        }
+    }
+
+    std::cout << ray_count / trace_seconds / 1e6 << " M rays/s, " << hits << " hits\n"
+              << disagreements << " rays disagree with the analytic sphere (grazing the "
+              << "silhouette); largest hit point distance " << max_error << "\n";
+    return 0;
+}
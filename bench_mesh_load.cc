@@ -0,0 +1,125 @@
+#include "rtweekend.h"
+
+#include "mesh_loader.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// Writes a tessellated sphere with about the requested number of triangles (default two
+// million) as an OBJ file with positions, texture coordinates and normals, as a
+// position-only OBJ, and as a binary PLY, then times loading each of them back and checks
+// the meshes against each other.
+
+struct grid {
+    int stacks, slices;
+
+    point3 position(int i, int j) const {
+        double theta = pi * i / stacks, phi = 2 * pi * j / slices;
+        return point3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+    }
+
+    int vertex(int i, int j) const { return i * (slices + 1) + j; }
+    int vertex_count() const { return (stacks + 1) * (slices + 1); }
+};
+
+void write_obj(const std::string& path, const grid& g, bool attributes) {
+    // Quads, so the loader's fan triangulation and de-duplication both get exercised.
+    std::ofstream out(path);
+    char line[160];     // Room for the longest line: a face of four 10-digit v/vt/vn triples
+    for (int i = 0; i <= g.stacks; i++) {
+        for (int j = 0; j <= g.slices; j++) {
+            auto p = g.position(i, j);
+            std::snprintf(line, sizeof line, "v %.6f %.6f %.6f\n", p.x(), p.y(), p.z());
+            out << line;
+            if (attributes) {
+                std::snprintf(line, sizeof line, "vt %.6f %.6f\nvn %.6f %.6f %.6f\n",
+                              double(j) / g.slices, double(i) / g.stacks, p.x(), p.y(), p.z());
+                out << line;
+            }
+        }
+    }
+    for (int i = 0; i < g.stacks; i++) {
+        for (int j = 0; j < g.slices; j++) {
+            int c[4] = { g.vertex(i, j) + 1, g.vertex(i + 1, j) + 1, g.vertex(i + 1, j + 1) + 1,
+                         g.vertex(i, j + 1) + 1 };
+            if (attributes)
+                std::snprintf(line, sizeof line, "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n",
+                              c[0], c[0], c[0], c[1], c[1], c[1], c[2], c[2], c[2], c[3], c[3], c[3]);
+            else
+                std::snprintf(line, sizeof line, "f %d %d %d %d\n", c[0], c[1], c[2], c[3]);
+            out << line;
+        }
+    }
+}
+
+void write_ply(const std::string& path, const grid& g) {
+    std::ofstream out(path, std::ios::binary);
+    out << "ply\nformat binary_little_endian 1.0\n"
+        << "element vertex " << g.vertex_count() << "\n"
+        << "property float x\nproperty float y\nproperty float z\n"
+        << "property float nx\nproperty float ny\nproperty float nz\n"
+        << "property float u\nproperty float v\n"
+        << "element face " << g.stacks * g.slices << "\n"
+        << "property list uchar int vertex_indices\nend_header\n";
+    for (int i = 0; i <= g.stacks; i++) {
+        for (int j = 0; j <= g.slices; j++) {
+            auto p = g.position(i, j);
+            float v[8] = { float(p.x()), float(p.y()), float(p.z()), float(p.x()), float(p.y()),
+                           float(p.z()), float(j) / g.slices, float(i) / g.stacks };
+            out.write(reinterpret_cast<const char*>(v), sizeof v);
+        }
+    }
+    for (int i = 0; i < g.stacks; i++) {
+        for (int j = 0; j < g.slices; j++) {
+            unsigned char count = 4;
+            int32_t c[4] = { g.vertex(i, j), g.vertex(i + 1, j), g.vertex(i + 1, j + 1), g.vertex(i, j + 1) };
+            out.write(reinterpret_cast<const char*>(&count), 1);
+            out.write(reinterpret_cast<const char*>(c), sizeof c);
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    long triangles = argc > 1 ? std::atol(argv[1]) : 2000000;
+    std::string base = argc > 2 ? argv[2] : "bench_mesh_load";
+
+    grid g;
+    g.stacks = std::max(2, int(std::sqrt(triangles / 4.0)));
+    g.slices = std::max(3, int(triangles / (2.0 * g.stacks)));
+
+    auto full_obj = base + ".obj", plain_obj = base + "_positions.obj", ply = base + ".ply";
+    write_obj(full_obj, g, true);
+    write_obj(plain_obj, g, false);
+    write_ply(ply, g);
+
+    // load_mesh reports the size, time and throughput of each load.
+    triangle_mesh_data a, b, c;
+    if (!load_mesh(full_obj, a) || !load_mesh(plain_obj, b) || !load_mesh(ply, c))
+        return 1;
+
+    // The three files describe the same triangles. De-duplication numbers the OBJ vertices
+    // in order of first use, so compare the triangles corner by corner.
+    bool match = a.triangle_count() == c.triangle_count() && b.triangle_count() == c.triangle_count()
+              && a.vertex_count() == c.vertex_count() && b.vertex_count() == c.vertex_count()
+              && a.normals.size() == c.normals.size() && a.uvs.size() == c.uvs.size();
+    double max_error = 0;
+    for (size_t k = 0; match && k < c.indices.size(); k++) {
+        for (int axis = 0; axis < 3; axis++) {
+            double reference = c.positions[3 * size_t(c.indices[k]) + axis];
+            max_error = std::max({ max_error,
+                std::fabs(a.positions[3 * size_t(a.indices[k]) + axis] - reference),
+                std::fabs(b.positions[3 * size_t(b.indices[k]) + axis] - reference) });
+        }
+    }
+    std::cout << (match ? "Meshes match" : "MESHES DIFFER") << ", max position difference "
+              << max_error << "\n";
+
+    std::remove(full_obj.c_str());
+    std::remove(plain_obj.c_str());
+    std::remove(ply.c_str());
+    return match && max_error < 1e-5 ? 0 : 1;
+}
@@ -0,0 +1,101 @@
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Renders the same image with raytracer and raytracer_float (cmake -DRT_FLOAT_RENDERER=ON)
+// and reports the time of each and the error of the float image against the double one.
+// The error is set against the noise floor, the difference between two double renders
+// with different seeds: float precision only matters where it stands out from that.
+// Arguments are passed to both renderers, e.g. bench_precision --scene 7 --spp 64.
+
+struct pfm_image {
+    int width = 0, height = 0;
+    std::vector<float> data;
+};
+
+bool read_pfm(const std::string& path, pfm_image& image) {
+    // Reads an RGB portable float map in host byte order, as pfm_writer writes it.
+    std::ifstream in(path, std::ios::binary);
+    std::string magic;
+    double scale;
+    if (!(in >> magic >> image.width >> image.height >> scale) || magic != "PF")
+        return false;
+    in.get();
+    image.data.resize(size_t(image.width) * image.height * 3);
+    return bool(in.read(reinterpret_cast<char*>(image.data.data()),
+                        image.data.size() * sizeof(float)));
+}
+
+std::string quoted(const std::string& s) {
+    std::string out = "'";
+    for (char c : s)
+        out += (c == '\'') ? std::string("'\\''") : std::string(1, c);
+    return out + "'";
+}
+
+double render(const std::string& program, const std::string& args, const std::string& output) {
+    // Runs one render and returns its wall time in seconds, or -1 if it failed.
+    auto command = quoted(program) + args + " --output " + quoted(output) + " > /dev/null 2>&1";
+    auto start = std::chrono::steady_clock::now();
+    if (std::system(command.c_str()) != 0)
+        return -1;
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void report(const char* label, const pfm_image& a, const pfm_image& b) {
+    // RMSE and largest channel difference, both also relative to the mean of a.
+    double sum_sq = 0, max_error = 0, mean = 0;
+    for (size_t k = 0; k < a.data.size(); k++) {
+        double d = double(b.data[k]) - double(a.data[k]);
+        sum_sq += d * d;
+        max_error = std::fmax(max_error, std::fabs(d));
+        mean += a.data[k];
+    }
+    mean /= double(a.data.size());
+    double rmse = std::sqrt(sum_sq / double(a.data.size()));
+    std::cout << label << ": RMSE " << rmse << " (" << 100 * rmse / mean << "% of mean), "
+              << "max " << max_error << "\n";
+}
+
+int main(int argc, char* argv[]) {
+    std::string dir = argv[0];
+    auto slash = dir.rfind('/');
+    dir = (slash == std::string::npos) ? "./" : dir.substr(0, slash + 1);
+
+    std::string args;
+    for (int k = 1; k < argc; k++)
+        args += " " + quoted(argv[k]);
+
+    const std::string double_file = "precision_double.pfm";
+    const std::string float_file = "precision_float.pfm";
+    const std::string reseeded_file = "precision_reseeded.pfm";
+
+    double double_time = render(dir + "raytracer", args, double_file);
+    double float_time = render(dir + "raytracer_float", args, float_file);
+    if (double_time < 0 || float_time < 0) {
+        std::cerr << "ERROR: Could not run raytracer and raytracer_float from " << dir
+                  << " (configure with -DRT_FLOAT_RENDERER=ON).\n";
+        return 1;
+    }
+    if (render(dir + "raytracer", args + " --seed 987654321", reseeded_file) < 0)
+        return 1;
+
+    pfm_image double_image, float_image, reseeded_image;
+    if (!read_pfm(double_file, double_image) || !read_pfm(float_file, float_image)
+        || !read_pfm(reseeded_file, reseeded_image)
+        || float_image.data.size() != double_image.data.size()
+        || reseeded_image.data.size() != double_image.data.size()) {
+        std::cerr << "ERROR: Could not read the rendered images.\n";
+        return 1;
+    }
+
+    std::cout << "double: " << double_time << " s\n"
+              << "float:  " << float_time << " s (" << double_time / float_time << "x)\n";
+    report("float against double", double_image, float_image);
+    report("noise floor (reseeded double)", double_image, reseeded_image);
+    return 0;
+}
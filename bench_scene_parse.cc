@@ -0,0 +1,68 @@
+#include "rtweekend.h"
+
+#include "scene_loader.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// Times loading a generated scene file with a given number of primitives (default one
+// million): a grid of small spheres, every tenth one a quad, over a handful of materials.
+// The scene is loaded three times: parsed, parsed while writing a scene cache, and from
+// that cache.
+
+int main(int argc, char* argv[]) {
+    long count = argc > 1 ? std::atol(argv[1]) : 1000000;
+    std::string path = argc > 2 ? argv[2] : "bench_scene_parse.scene";
+    std::string cache_path = path + ".cache";
+
+    {
+        std::ofstream out(path);
+        out << "camera aspect 1 width 400 spp 16 depth 8\n"
+            << "camera lookfrom 500 500 -1500 lookat 500 500 0 vfov 40\n"
+            << "material m0 lambertian 0.8 0.3 0.3\n"
+            << "material m1 lambertian 0.3 0.8 0.3\n"
+            << "material m2 metal 0.9 0.9 0.9 0.1\n"
+            << "material m3 dielectric 1.5\n";
+
+        long side = long(std::cbrt(double(count))) + 1;
+        char line[160];
+        for (long k = 0; k < count; k++) {
+            double x = double(k % side), y = double((k / side) % side), z = double(k / side / side);
+            int mat = int(k % 4);
+            if (k % 10 == 9)
+                std::snprintf(line, sizeof(line), "quad m%d %.3f %.3f %.3f 0.4 0 0 0 0.4 0\n",
+                              mat, x * 10, y * 10, z * 10);
+            else
+                std::snprintf(line, sizeof(line), "sphere m%d %.3f %.3f %.3f 0.25\n",
+                              mat, x * 10, y * 10, z * 10);
+            out << line;
+        }
+    }
+
+    std::remove(cache_path.c_str());
+
+    scene_description parsed;
+    if (!load_scene(path, parsed))
+        return 1;
+    std::cout << parsed.primitive_count << " primitives: parsed in " << parsed.parse_seconds
+              << " s (" << parsed.primitive_count / parsed.parse_seconds / 1e6
+              << " M primitives/s), BVH built in " << parsed.build_seconds << " s\n";
+
+    scene_description cold;
+    if (!load_scene(path, cold, cache_path))
+        return 1;
+    std::cout << "With a cache to write: parsed in " << cold.parse_seconds
+              << " s, cache written and mapped in " << cold.build_seconds << " s\n";
+
+    scene_description warm;
+    if (!load_scene(path, warm, cache_path) || !warm.from_cache)
+        return 1;
+    std::cout << "From the cache: loaded in " << warm.parse_seconds * 1000 << " ms\n";
+
+    std::remove(path.c_str());
+    std::remove(cache_path.c_str());
+    return 0;
+}
@@ -0,0 +1,108 @@
+#include "rtweekend.h"
+
+#include "material.h"
+#include "quad.h"
+#include "sphere.h"
+#include "transform.h"
+#include "triangle_mesh.h"
+
+#include <iomanip>
+#include <iostream>
+
+// Spawns rays from hit points on a sphere, a rotated and stretched box of quads and a
+// triangle mesh, at scene scales from 1e-5 to 1e13, and counts the rays that go wrong. A
+// ray leaving a convex object must not hit it again (acne); a ray entering it must reach
+// the far side rather than hit its own entry point or miss the object (a leak). This is
+// done with the old fixed t_min of 0.001 and with origins offset by the error bounds of
+// the hit points (hit_record::spawn_origin).
+
+constexpr int rays_per_case = 20000;
+
+struct failures {
+    int acne = 0;
+    int leaks = 0;
+};
+
+triangle_mesh_data octahedron(const point3& center, double radius) {
+    triangle_mesh_data mesh;
+    for (int axis = 0; axis < 3; axis++) {
+        for (int sign : { 1, -1 }) {
+            vec3 offset(0, 0, 0);
+            offset[axis] = sign * radius;
+            mesh.add_vertex(center + offset);
+        }
+    }
+    // Vertices: 0 +x, 1 -x, 2 +y, 3 -y, 4 +z, 5 -z
+    const uint32_t faces[8][3] = { {0,2,4}, {2,1,4}, {1,3,4}, {3,0,4},
+                                   {2,0,5}, {1,2,5}, {3,1,5}, {0,3,5} };
+    for (const auto& f : faces)
+        mesh.add_triangle(f[0], f[1], f[2]);
+    return mesh;
+}
+
+failures count_failures(const hittable& object, const point3& center, double size,
+                        bool error_bounds) {
+    failures result;
+    const interval spawn_t = error_bounds ? interval(0, infinity) : interval(0.001, infinity);
+    for (int k = 0; k < rays_per_case; k++) {
+        // A ray from well outside toward a random point near the center.
+        auto origin = center + 4 * size * random_unit_vector();
+        auto target = center + 0.5 * size * random_unit_vector();
+        hit_record rec;
+        if (!object.hit(ray(origin, target - origin), interval(0, infinity), rec))
+            continue;
+
+        // rec.normal faces the incoming ray, so it points out of the object.
+        auto outward = random_on_hemisphere(rec.normal);
+        for (bool leaving : { true, false }) {
+            auto direction = leaving ? outward : -outward;
+            auto start = error_bounds ? rec.spawn_origin(direction) : rec.p;
+            hit_record next;
+            bool hit = object.hit(ray(start, direction), spawn_t, next);
+            if (leaving)
+                result.acne += hit;
+            else if (!hit)
+                result.leaks++;
+            else if (next.t < 1e-6 * size)
+                result.acne++;
+        }
+    }
+    return result;
+}
+
+int main() {
+    auto white = make_shared<lambertian>(color(.73, .73, .73));
+    const char* methods[2] = { "t_min 0.001", "error bounds" };
+
+    std::cout << "Failed rays out of " << 2 * rays_per_case << " per case (acne / leaks)\n"
+              << std::setw(8) << "scale" << std::setw(10) << "method"
+              << std::setw(22) << "sphere" << std::setw(14) << "box"
+              << std::setw(14) << "mesh" << "\n";
+
+    // A mesh normal squares the cross product of two edges, which overflows a float at
+    // scales much beyond 1e9.
+    const double max_scale = sizeof(real) == sizeof(float) ? 1e9 : 1e13;
+    for (double scale = 1e-5; scale <= max_scale; scale *= 100) {
+        // Away from the origin, where coordinates carry more rounding error than size.
+        const point3 center = scale * point3(3, 1, 2);
+        sphere ball(center, scale, white);
+        transform stretched_box(box(point3(-0.5, -0.5, -0.5), point3(0.5, 0.5, 0.5), white),
+                                affine::translation(center)
+                                * affine::rotation(vec3(1, 2, 3), 40)
+                                * affine::scaling(vec3(2 * scale, scale, 0.5 * scale)));
+        triangle_mesh mesh(octahedron(center, scale), white);
+
+        for (int method = 0; method < 2; method++) {
+            std::cout << std::setw(8) << scale << std::setw(14) << methods[method];
+            for (const hittable* object : { (const hittable*)&ball,
+                                            (const hittable*)&stretched_box,
+                                            (const hittable*)&mesh }) {
+                auto f = count_failures(*object, center, scale, method == 1);
+                std::cout << std::setw(10) << f.acne << " / " << std::setw(5) << std::left
+                          << f.leaks << std::right;
+            }
+            std::cout << "\n";
+        }
+    }
+    return 0;
+}
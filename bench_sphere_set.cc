@@ -0,0 +1,100 @@
+#include "rtweekend.h"
+
+#include "linear_bvh.h"
+#include "material.h"
+#include "sphere.h"
+#include "sphere_set.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+// Fills a cube with random particles (default one million) and traces the same rays
+// through a linear_bvh of sphere objects and through a sphere_set, reporting build time,
+// memory and ray throughput for each and checking that they find the same hits.
+
+template <typename Object>
+double trace_seconds(const Object& object, const std::vector<ray>& rays, int& hits) {
+    hits = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& r : rays) {
+        hit_record rec;
+        if (object.hit(r, interval(0.001, infinity), rec))
+            hits++;
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[]) {
+    long count = argc > 1 ? std::atol(argv[1]) : 1000000;
+    const double extent = 100, radius = extent / std::cbrt(double(count)) * 0.4;
+
+    std::vector<shared_ptr<material>> materials;
+    for (int k = 0; k < 4; k++)
+        materials.push_back(make_shared<lambertian>(color::random()));
+
+    std::vector<point3> centers;
+    for (long k = 0; k < count; k++)
+        centers.push_back(extent * point3(random_double(), random_double(), random_double()));
+
+    auto start = std::chrono::steady_clock::now();
+    hittable_list list;
+    for (long k = 0; k < count; k++)
+        list.add(make_shared<sphere>(centers[k], radius, materials[k % 4]));
+    bvh_build_options options;
+    options.method = bvh_split_method::sah;
+    linear_bvh objects(list, options);
+    auto objects_seconds = seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    sphere_set set;
+    for (long k = 0; k < count; k++)
+        set.add(centers[k], radius, materials[k % 4]);
+    set.build();
+    auto set_seconds = seconds_since(start);
+
+    // A sphere object is allocated together with its shared_ptr control block, and the
+    // list and the BVH each hold a pointer to it.
+    double object_bytes = double(count) * (sizeof(sphere) + 16 + sizeof(shared_ptr<hittable>)
+                                           + sizeof(hittable*))
+                        + double(objects.node_count()) * sizeof(linear_bvh_node);
+    std::cout << count << " spheres, " << sphere_set::lanes << " per SIMD block\n"
+              << "sphere objects: built in " << objects_seconds << " s, about "
+              << object_bytes / count << " bytes per sphere\n"
+              << "sphere_set:     built in " << set_seconds << " s, "
+              << double(set.memory_bytes()) / count << " bytes per sphere\n";
+
+    std::vector<ray> rays;
+    for (int k = 0; k < 1000000; k++) {
+        auto origin = point3(extent / 2, extent / 2, extent / 2) + 2 * extent * random_unit_vector();
+        auto target = extent * point3(random_double(), random_double(), random_double());
+        rays.emplace_back(origin, target - origin);
+    }
+
+    int object_hits, set_hits;
+    auto object_time = trace_seconds(objects, rays, object_hits);
+    auto set_time = trace_seconds(set, rays, set_hits);
+    std::cout << "sphere objects: " << rays.size() / object_time / 1e6 << " M rays/s, "
+              << object_hits << " hits\n"
+              << "sphere_set:     " << rays.size() / set_time / 1e6 << " M rays/s, "
+              << set_hits << " hits (" << object_time / set_time << "x)\n";
+
+    int disagreements = 0;
+    double max_error = 0;
+    for (const auto& r : rays) {
+        hit_record a, b;
+        bool hit_a = objects.hit(r, interval(0.001, infinity), a);
+        bool hit_b = set.hit(r, interval(0.001, infinity), b);
+        if (hit_a != hit_b || (hit_a && a.mat != b.mat))
+            disagreements++;
+        else if (hit_a)
+            max_error = std::fmax(max_error, std::fabs(a.t - b.t));
+    }
+    std::cout << disagreements << " rays disagree; largest difference in t " << max_error << "\n";
+    return 0;
+}
@@ -0,0 +1,122 @@
+#include "rtweekend.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Times the vec3 operators on the padded SIMD basic_vec3 against a plain three-component
+// vector with scalar operators (vec3 as it used to be), in float and double: add,
+// multiply, scale, dot, cross and normalize, each over arrays that stay in L1 cache.
+// Results are checked to agree, then reported in nanoseconds per operation.
+
+template <typename T>
+struct plain_vec3 {
+    T e[3];
+
+    plain_vec3() : e{0,0,0} {}
+    plain_vec3(T e0, T e1, T e2) : e{e0,e1,e2} {}
+
+    T x() const { return e[0]; }
+    T y() const { return e[1]; }
+    T z() const { return e[2]; }
+};
+
+template <typename T> plain_vec3<T> operator+(const plain_vec3<T>& u, const plain_vec3<T>& v) {
+    return plain_vec3<T>(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
+}
+template <typename T> plain_vec3<T> operator*(const plain_vec3<T>& u, const plain_vec3<T>& v) {
+    return plain_vec3<T>(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
+}
+template <typename T> plain_vec3<T> operator*(T t, const plain_vec3<T>& v) {
+    return plain_vec3<T>(t*v.e[0], t*v.e[1], t*v.e[2]);
+}
+template <typename T> T dot(const plain_vec3<T>& u, const plain_vec3<T>& v) {
+    return u.e[0]*v.e[0] + u.e[1]*v.e[1] + u.e[2]*v.e[2];
+}
+template <typename T> plain_vec3<T> cross(const plain_vec3<T>& u, const plain_vec3<T>& v) {
+    return plain_vec3<T>(u.e[1]*v.e[2] - u.e[2]*v.e[1],
+                         u.e[2]*v.e[0] - u.e[0]*v.e[2],
+                         u.e[0]*v.e[1] - u.e[1]*v.e[0]);
+}
+template <typename T> plain_vec3<T> unit_vector(const plain_vec3<T>& v) {
+    return (1 / std::sqrt(dot(v, v))) * v;
+}
+
+constexpr int array_size = 1024;
+constexpr int repeats = 20000;
+
+volatile double sink;   // Stores to it keep every timed repeat from being optimized away
+
+template <typename V, typename Op>
+double time_op(const std::vector<V>& a, const std::vector<V>& b, std::vector<V>& out, Op op) {
+    // Seconds per operation of out[k] = op(a[k], b[k]); the best of three runs.
+    double best = infinity;
+    for (int run = 0; run < 3; run++) {
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < repeats; r++) {
+            for (int k = 0; k < array_size; k++)
+                out[k] = op(a[k], b[k]);
+            sink = out[r % array_size].x();     // Keeps every repeat live
+        }
+        auto end = std::chrono::steady_clock::now();
+        auto seconds = std::chrono::duration<double>(end - start).count();
+        best = std::fmin(best, seconds / (double(repeats) * array_size));
+    }
+    return best;
+}
+
+template <typename T>
+bool same(const basic_vec3<T>& u, const plain_vec3<T>& v) {
+    return u.x() == v.x() && u.y() == v.y() && u.z() == v.z();
+}
+
+template <typename T>
+void run(const char* type) {
+    using simd = basic_vec3<T>;
+    using plain = plain_vec3<T>;
+
+    std::vector<simd> sa(array_size), sb(array_size), sout(array_size);
+    std::vector<plain> pa(array_size), pb(array_size), pout(array_size);
+    for (int k = 0; k < array_size; k++) {
+        sa[k] = simd(basic_vec3<double>::random(-1, 1));
+        sb[k] = simd(basic_vec3<double>::random(-1, 1));
+        pa[k] = plain(sa[k].x(), sa[k].y(), sa[k].z());
+        pb[k] = plain(sb[k].x(), sb[k].y(), sb[k].z());
+    }
+
+    std::cout << type << " (" << sizeof(simd) << " bytes against " << sizeof(plain) << ")\n";
+    int mismatches = 0;
+    auto report = [&](const char* name, auto simd_op, auto plain_op) {
+        double simd_time = time_op(sa, sb, sout, simd_op);
+        double plain_time = time_op(pa, pb, pout, plain_op);
+        for (int k = 0; k < array_size; k++)
+            mismatches += !same(sout[k], pout[k]);
+        std::cout << "  " << name << std::string(12 - std::string(name).size(), ' ')
+                  << simd_time * 1e9 << " ns   plain " << plain_time * 1e9 << " ns   ("
+                  << plain_time / simd_time << "x)\n";
+    };
+
+    report("add", [](const simd& u, const simd& v) { return u + v; },
+                  [](const plain& u, const plain& v) { return u + v; });
+    report("multiply", [](const simd& u, const simd& v) { return u * v; },
+                       [](const plain& u, const plain& v) { return u * v; });
+    report("scale", [](const simd& u, const simd& v) { return v.x() * u; },
+                    [](const plain& u, const plain& v) { return v.x() * u; });
+    report("dot", [](const simd& u, const simd& v) { return simd(dot(u, v), 0, 0); },
+                  [](const plain& u, const plain& v) { return plain(dot(u, v), 0, 0); });
+    report("cross", [](const simd& u, const simd& v) { return cross(u, v); },
+                    [](const plain& u, const plain& v) { return cross(u, v); });
+    report("normalize", [](const simd& u, const simd&) { return unit_vector(u); },
+                        [](const plain& u, const plain&) { return unit_vector(u); });
+    if (mismatches)
+        std::cout << "  " << mismatches << " results differ from the plain vector (expected"
+                  << " only where the compiler fuses the plain code's multiply-adds)\n";
+}
+
+int main() {
+    run<float>("float");
+    run<double>("double");
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include "rtweekend.h"
+
+#include "linear_bvh.h"
+#include "material.h"
+#include "quad.h"
+#include "sphere.h"
+#include "wide_bvh.h"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <type_traits>
+
+// Builds the final_scene geometry (box grid plus a cluster of spheres) with each split
+// method and tree width, and reports SAH cost, build time and measured ray throughput.
+
+hittable_list final_scene_geometry() {
+    hittable_list objects;
+    auto ground = make_shared<lambertian>(color(0.48, 0.83, 0.53));
+
+    int boxes_per_side = 20;
+    for (int i = 0; i < boxes_per_side; i++) {
+        for (int j = 0; j < boxes_per_side; j++) {
+            auto w = 100.0;
+            auto x0 = -1000.0 + i*w;
+            auto z0 = -1000.0 + j*w;
+            auto y1 = random_double(1, 101);
+            objects.add(box(point3(x0, 0, z0), point3(x0 + w, y1, z0 + w), ground));
+        }
+    }
+
+    auto white = make_shared<lambertian>(color(0.73, 0.73, 0.73));
+    for (int j = 0; j < 1000; j++)
+        objects.add(make_shared<sphere>(point3::random(0,165) + vec3(-1000, 270, 395), 10, white));
+
+    objects.add(make_shared<sphere>(point3(400, 200, 400), 100, white));
+    objects.add(make_shared<sphere>(point3(220, 280, 300), 80, white));
+
+    return objects;
+}
+
+template <typename BVH>
+double trace(const BVH& bvh, const std::vector<ray>& rays, int& hits) {
+    // Returns the measured throughput in millions of rays per second.
+    hits = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& r : rays) {
+        hit_record rec;
+        if (bvh.hit(r, interval(0.001, infinity), rec))
+            hits++;
+    }
+    auto end = std::chrono::steady_clock::now();
+    return rays.size() / std::chrono::duration<double>(end - start).count() / 1e6;
+}
+
+template <typename BVH>
+void report(const char* name, const hittable_list& objects, const bvh_build_options& options,
+            const std::vector<ray>& rays) {
+    auto build_start = std::chrono::steady_clock::now();
+    BVH bvh(objects, options);
+    auto build_end = std::chrono::steady_clock::now();
+    auto build_ms = std::chrono::duration<double, std::milli>(build_end - build_start).count();
+
+    int hits;
+    auto mrays = trace(bvh, rays, hits);
+
+    std::cout << std::left << std::setw(12) << name
+              << "  nodes " << std::setw(6) << bvh.node_count();
+    if constexpr (std::is_same_v<BVH, linear_bvh>)
+        std::cout << "  SAH cost " << std::setw(10) << bvh.sah_cost();
+    else
+        std::cout << "  SAH cost " << std::setw(10) << "-";
+    std::cout << "  build " << std::setw(8) << build_ms << " ms"
+              << "  " << std::setw(8) << mrays << " Mrays/s"
+              << "  (" << hits << " hits)\n";
+}
+
+int main() {
+    auto objects = final_scene_geometry();
+
+    // Rays from the final_scene camera towards random points in the scene bounds.
+    std::vector<ray> rays;
+    const point3 lookfrom(478, 278, -600);
+    for (int i = 0; i < 1000000; i++) {
+        auto target = point3(random_double(-1000, 1000), random_double(0, 600),
+                             random_double(-1000, 1000));
+        rays.push_back(ray(lookfrom, target - lookfrom));
+    }
+
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << objects.objects.size() << " objects, " << rays.size() << " rays\n";
+
+    bvh_build_options median;
+    median.method = bvh_split_method::median;
+    report<linear_bvh>("median", objects, median, rays);
+
+    bvh_build_options sah;
+    sah.method = bvh_split_method::sah;
+    report<linear_bvh>("sah", objects, sah, rays);
+    report<bvh4>("sah bvh4", objects, sah, rays);
+    report<bvh8>("sah bvh8", objects, sah, rays);
+}
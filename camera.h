@@ -7,17 +7,22 @@
 
 #include "color.h"
 #include "hittable.h"
+#include "image_writer.h"
 #include "material.h"
 #include "pdf.h"
+#include "pixel_stats.h"
+#include "render_checkpoint.h"
+#include "render_shard.h"
+#include "tile_scheduler.h"
 #include <atomic>
 #include <chrono>
-#include <condition_variable>
-#include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
-#include <format>
-#include <sstream>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 using namespace std::chrono;
 
@@ -29,6 +34,46 @@ public:
   int max_depth = 10;
   color background;
   int num_threads = 0; // 0 means use OpenMP default
+  uint64_t seed = 0;   // Same seed gives the same image regardless of thread count
+  bool use_ray_packets = false; // Trace camera rays in SIMD packets of ray_packet::size
+  int rr_min_bounces = 3; // Bounces before Russian roulette may end a path (>= max_depth disables)
+  std::string output_file = "image.png"; // .png, .pfm or .ppm; empty writes PPM to stdout
+  int tile_size = 32;                    // Tiles are tile_size x tile_size pixels
+  tile_order tile_ordering = tile_order::hilbert;
+
+  // Adaptive sampling: every pixel takes passes of samples_per_pixel samples until, after
+  // at least adaptive_min_samples, the estimated error in it and its neighbours falls
+  // below adaptive_threshold, or until max_samples_per_pixel is reached.
+  bool adaptive_sampling = false;
+  double adaptive_threshold = 0.05; // Standard error of gamma-corrected luminance
+  int adaptive_min_samples = 64; // Guards against stopping before a rare bright path is seen
+  int max_samples_per_pixel = 1024;
+  std::string sample_count_file; // If set, write a mask of samples spent per pixel
+
+  // Progressive rendering: the whole image is refined in passes of progressive_pass_samples
+  // samples per pixel, up to samples_per_pixel in total, with a preview written to
+  // output_file every checkpoint_passes passes or checkpoint_seconds seconds. The render
+  // stops early, on a pass boundary, rather than overrun time_budget_seconds.
+  bool progressive = false;
+  int progressive_pass_samples = 16;
+  int checkpoint_passes = 0;       // 0 disables
+  double checkpoint_seconds = 0;   // 0 disables
+  double time_budget_seconds = 0;  // 0 means no limit
+
+  // If set, progressive renders also save their accumulation buffer here at every
+  // checkpoint and when the time budget runs out. With resume, a render whose settings
+  // match the saved ones continues from it, giving the same image as an uninterrupted run.
+  std::string checkpoint_file;
+  bool resume = false;
+
+  // Sharded rendering: with shard_count > 1 this process renders only shard shard_index
+  // of the frame, by image region or by range of progressive passes, and saves its partial
+  // accumulation to shard_file (default output_file.shard<index>) instead of writing an
+  // image. merge_shards combines a full set of shard files.
+  int shard_index = 0;
+  int shard_count = 1;
+  shard_split shard_mode = shard_split::regions;
+  std::string shard_file;
 
   double vfov = 90;                  // Vertical view angle (field of view)
   point3 lookfrom = point3(0, 0, 0); // Point camera is looking from
@@ -38,86 +83,310 @@ public:
   double defocus_angle = 0; // Variation angle of rays through each pixel
   double focus_dist = 10;
 
-  void render(const hittable &world, const hittable &lights) {
+  // Each render returns false if the image (or shard buffer) could not be written.
+  bool render(const hittable &world, const hittable &lights) {
+    return render(world, &lights);
+  }
+
+  bool render(const hittable &world) {
+    // Without a light list, bounces are sampled from the material PDFs alone.
+    return render(world, nullptr);
+  }
+
+private:
+  bool render(const hittable &world, const hittable *lights) {
     initialize();
 
-    std::cout << "P3\n" << image_width << ' ' << image_height << "\n255\n";
+    if (progressive || shard_count > 1)
+      return render_progressive(world, lights);
+
+    framebuffer image(image_width, image_height);
+    framebuffer sample_counts;
+    if (!sample_count_file.empty())
+      sample_counts.resize(image_width, image_height);
+    std::atomic<long long> total_samples(0);
 
-    int chunk_size = 16;
+    auto tiles = make_tiles(image_width, image_height, tile_size, tile_ordering);
 
-    // Use a thread-safe vector with pre-allocated size
-    std::vector<std::string> output_buffer(image_height * image_width);
-    std::mutex output_mutex;
+#ifdef _OPENMP
+    int thread_count = (num_threads > 0) ? num_threads : omp_get_max_threads();
+#else
+    int thread_count = 1;
+#endif
+    tile_scheduler scheduler(int(tiles.size()), thread_count);
 
-    std::atomic<int> scanlines_completed(0);
+    std::atomic<int> tiles_completed(0);
     std::atomic<bool> rendering_complete(false);
-    std::condition_variable cv;
-    std::mutex cv_mutex;
 
-    std::thread progress_thread(progress_tracker, std::ref(scanlines_completed),
-                                std::ref(rendering_complete), std::ref(cv),
-                                std::ref(cv_mutex), image_height);
+    std::thread progress_thread(progress_tracker, std::ref(tiles_completed),
+                                std::ref(rendering_complete), int(tiles.size()));
 
-#pragma omp parallel
+#pragma omp parallel num_threads(thread_count)
     {
+#ifdef _OPENMP
+      int thread = omp_get_thread_num();
+#else
+      int thread = 0;
+#endif
       // Thread-local temporary storage
-      std::vector<std::string> local_buffer(image_width);
-
-#pragma omp for schedule(dynamic, chunk_size)
-      // Iterate over image dimensions
-      for (int j = 0; j < image_height; j++) {
-        local_buffer.clear();
-        local_buffer.reserve(image_width);
-        for (int i = 0; i < image_width; i++) {
-          color pixel_color(0, 0, 0);
-          // stratified sampling
-          for (int s_j = 0; s_j < sqrt_spp; s_j++) {
-            for (int s_i = 0; s_i < sqrt_spp; s_i++) {
-              ray r = get_ray(i, j, s_i, s_j);
-              pixel_color += ray_color(r, max_depth, world, lights);
-            }
+      std::vector<pixel_stats> tile_stats;
+
+      int t;
+      while (scheduler.next(thread, t)) {
+        const tile &region = tiles[t];
+
+        render_tile(region, world, lights, tile_stats);
+
+        // Tiles are disjoint, so threads write the framebuffer without locking
+        int tile_width = region.x1 - region.x0;
+        for (int j = region.y0; j < region.y1; j++) {
+          long long span_samples = 0;
+          for (int i = region.x0; i < region.x1; i++) {
+            const pixel_stats &px = tile_stats[(j - region.y0) * tile_width + i - region.x0];
+            image.set(i, j, px.average());
+            span_samples += px.count;
+            if (!sample_count_file.empty())
+              sample_counts.set(i, j, color(1, 1, 1) * (double(px.count) / max_pixel_samples));
           }
+          total_samples += span_samples;
+        }
 
-          // Convert pixel color to string
-          std::ostringstream pixel_stream;
-          auto scaled_color = pixel_samples_scale * pixel_color;
-          write_color(pixel_stream, scaled_color);
+        ++tiles_completed;
+      }
+    }
 
-          local_buffer.push_back(pixel_stream.str());
-        }
+    rendering_complete = true;
+
+    progress_thread.join();
+
+    if (adaptive_sampling)
+      std::clog << "\nAverage samples per pixel: "
+                << double(total_samples) / (double(image_width) * image_height) << '\n';
+
+    bool written = write_image(image, output_file);
+    if (!sample_count_file.empty())
+      written = write_image(sample_counts, sample_count_file) && written;
+    return written;
+  }
+
+  bool render_progressive(const hittable &world, const hittable *lights) {
+    // A sample-range shard takes its slice of the passes; other renders take them all.
+    int first_pass = 0;
+    int end_pass = total_passes;
+    if (shard_count > 1 && shard_mode == shard_split::samples) {
+      first_pass = int(int64_t(total_passes) * shard_index / shard_count);
+      end_pass = int(int64_t(total_passes) * (shard_index + 1) / shard_count);
+    }
+
+    accumulation.assign(size_t(image_width) * image_height, pixel_stats());
+    passes_done = first_pass;
+    if (resume && !checkpoint_file.empty())
+      load_checkpoint();
+
+    auto tiles = make_tiles(image_width, image_height, tile_size, tile_ordering);
+
+    // A region shard takes every shard_count-th tile along the curve, which spreads hot
+    // spots evenly over the shards.
+    if (shard_count > 1 && shard_mode == shard_split::regions) {
+      std::vector<tile> shard_tiles;
+      for (size_t k = shard_index; k < tiles.size(); k += shard_count)
+        shard_tiles.push_back(tiles[k]);
+      tiles.swap(shard_tiles);
+    }
+
+#ifdef _OPENMP
+    int thread_count = (num_threads > 0) ? num_threads : omp_get_max_threads();
+#else
+    int thread_count = 1;
+#endif
+
+    std::atomic<int> tiles_completed(int(tiles.size()) *
+                                     std::max(0, std::min(passes_done, end_pass) - first_pass));
+    std::atomic<bool> rendering_complete(false);
 
-        {
-          std::lock_guard<std::mutex> lock(output_mutex);
-          std::copy(local_buffer.begin(), local_buffer.end(),
-                    output_buffer.begin() + j * image_width);
+    std::thread progress_thread(progress_tracker, std::ref(tiles_completed),
+                                std::ref(rendering_complete),
+                                int(tiles.size()) * (end_pass - first_pass));
+
+    // Pixels still taking samples; adaptive sampling retires converged pixels between passes
+    std::vector<unsigned char> active(accumulation.size(), 1);
+
+    auto start_time = steady_clock::now();
+    auto last_checkpoint = start_time;
+
+    while (passes_done < end_pass) {
+      int pass = passes_done;
+      auto pass_start = steady_clock::now();
+
+      if (adaptive_sampling && pass > first_pass) {
+        bool any_active = false;
+        for (int y = 0; y < image_height; y++) {
+          for (int x = 0; x < image_width; x++) {
+            active[size_t(y) * image_width + x] =
+                needs_more_samples(accumulation.data(), image_width, image_height, x, y);
+            any_active |= bool(active[size_t(y) * image_width + x]);
+          }
         }
-        ++scanlines_completed;
+        if (!any_active)
+          break;
+      }
+
+      tile_scheduler scheduler(int(tiles.size()), thread_count);
+
+#pragma omp parallel num_threads(thread_count)
+      {
+#ifdef _OPENMP
+        int thread = omp_get_thread_num();
+#else
+        int thread = 0;
+#endif
+        int t;
+        while (scheduler.next(thread, t)) {
+          const tile &region = tiles[t];
+
+          // Tiles are disjoint, so threads accumulate without locking
+          for (int j = region.y0; j < region.y1; j++) {
+            size_t offset = size_t(j) * image_width + region.x0;
+            if (use_ray_packets)
+              render_span_packets(j, region.x0, region.x1, pass, world, lights,
+                                  &accumulation[offset], &active[offset]);
+            else
+              render_span(j, region.x0, region.x1, pass, world, lights,
+                          &accumulation[offset], &active[offset]);
+          }
 
-        {
-          std::lock_guard<std::mutex> lock(cv_mutex);
-          cv.notify_one();
+          ++tiles_completed;
         }
       }
+
+      passes_done++;
+
+      auto now = steady_clock::now();
+      auto elapsed = duration<double>(now - start_time).count();
+      auto pass_seconds = duration<double>(now - pass_start).count();
+
+      // Stop rather than start a pass that would likely overrun the budget.
+      bool out_of_time = time_budget_seconds > 0 && passes_done < end_pass &&
+                         elapsed + pass_seconds > time_budget_seconds;
+      if (out_of_time) {
+        std::clog << "\nTime budget reached after " << passes_done << " of " << end_pass
+                  << " passes\n";
+        save_checkpoint();
+        break;
+      }
+
+      bool checkpoint =
+          (checkpoint_passes > 0 && passes_done % checkpoint_passes == 0) ||
+          (checkpoint_seconds > 0 &&
+           duration<double>(now - last_checkpoint).count() >= checkpoint_seconds);
+      if (checkpoint && passes_done < end_pass) {
+        write_accumulation();
+        save_checkpoint();
+        last_checkpoint = now;
+      }
     }
 
     rendering_complete = true;
-    {
-      std::lock_guard<std::mutex> lock(cv_mutex);
-      cv.notify_one();
-    }
 
     progress_thread.join();
 
-    // Write all pixels in the correct order after parallel processing
-    for (const auto &pixel_str : output_buffer) {
-      std::cout << pixel_str;
+    if (shard_count > 1) {
+      auto path = shard_file.empty() ? shard_file_name(output_file, shard_index) : shard_file;
+      return render_checkpoint::save(path, make_checkpoint_header(), accumulation);
     }
+    return write_accumulation();
+  }
+
+  uint64_t settings_fingerprint() const {
+    // Everything besides the seed and pass size that changes which samples are taken or
+    // what they return. The scene itself cannot be checked, so resume only with the same
+    // scene.
+    return checkpoint_fingerprint()
+        .add(max_depth).add(rr_min_bounces).add(background)
+        .add(vfov).add(lookfrom).add(lookat).add(vup).add(defocus_angle).add(focus_dist)
+        .add(adaptive_sampling).add(adaptive_threshold).add(adaptive_min_samples)
+        .value();
+  }
+
+  checkpoint_header make_checkpoint_header() const {
+    checkpoint_header header = {};
+    header.width = uint32_t(image_width);
+    header.height = uint32_t(image_height);
+    header.pass_samples = uint32_t(sqrt_spp * sqrt_spp);
+    header.passes_done = uint32_t(passes_done);
+    header.seed = seed;
+    header.fingerprint = settings_fingerprint();
+    header.shard_index = uint32_t(shard_count > 1 ? shard_index : 0);
+    header.shard_count = uint32_t(std::max(shard_count, 1));
+    header.shard_split = uint32_t(shard_mode);
+    return header;
+  }
+
+  void save_checkpoint() const {
+    if (!checkpoint_file.empty())
+      render_checkpoint::save(checkpoint_file, make_checkpoint_header(), accumulation);
+  }
+
+  void load_checkpoint() {
+    checkpoint_header header;
+    std::vector<pixel_stats> saved;
+    if (!render_checkpoint::load(checkpoint_file, header, saved)) {
+      std::clog << "No usable checkpoint at '" << checkpoint_file << "', starting afresh\n";
+      return;
+    }
+
+    auto expected = make_checkpoint_header();
+    if (header.width != expected.width || header.height != expected.height ||
+        header.pass_samples != expected.pass_samples || header.seed != expected.seed ||
+        header.fingerprint != expected.fingerprint ||
+        header.shard_index != expected.shard_index ||
+        header.shard_count != expected.shard_count ||
+        header.shard_split != expected.shard_split) {
+      std::clog << "Checkpoint '" << checkpoint_file
+                << "' was made with different settings, starting afresh\n";
+      return;
+    }
+
+    accumulation.swap(saved);
+    passes_done = int(header.passes_done);
+    std::clog << "Resuming from pass " << passes_done << " of " << total_passes << '\n';
+  }
+
+  bool write_accumulation() const {
+    // Resolve the accumulation buffer into an image (and sample mask) and write it out.
+    framebuffer image(image_width, image_height);
+    framebuffer sample_counts;
+    if (!sample_count_file.empty())
+      sample_counts.resize(image_width, image_height);
+
+    long long total_samples = 0;
+    for (int j = 0; j < image_height; j++) {
+      for (int i = 0; i < image_width; i++) {
+        const pixel_stats &px = accumulation[size_t(j) * image_width + i];
+        image.set(i, j, px.average());
+        total_samples += px.count;
+        if (!sample_count_file.empty())
+          sample_counts.set(i, j, color(1, 1, 1) * (double(px.count) / max_pixel_samples));
+      }
+    }
+
+    if (adaptive_sampling)
+      std::clog << "\nAverage samples per pixel: "
+                << double(total_samples) / (double(image_width) * image_height) << '\n';
+
+    bool written = write_image(image, output_file);
+    if (!sample_count_file.empty())
+      written = write_image(sample_counts, sample_count_file) && written;
+    return written;
   }
 
-private:
   int image_height;           // Rendered image height
   double pixel_samples_scale; // Color scale factor for a sum of pixel samples
   int sqrt_spp;
+  int max_pixel_samples;      // Most samples any pixel may take
+  int total_passes;           // Progressive passes in a full render
+  int passes_done;            // Progressive passes accumulated so far
+  std::vector<pixel_stats> accumulation; // Progressive sample totals, row-major
   double recip_sqrt_spp;
   point3 center;       // Camera center
   point3 pixel00_loc;  // Location of pixel 0,0
@@ -131,10 +400,24 @@ private:
     image_height = int(image_width / aspect_ratio);
     image_height = (image_height < 1) ? 1 : image_height;
 
-    sqrt_spp = int(std::sqrt(samples_per_pixel));
+    // A progressive pass is one stratified set of progressive_pass_samples samples;
+    // otherwise the first (and, without adaptive sampling, only) pass is samples_per_pixel.
+    sqrt_spp = int(std::sqrt(progressive ? progressive_pass_samples : samples_per_pixel));
+    sqrt_spp = std::max(sqrt_spp, 1);
     pixel_samples_scale = 1.0 / (sqrt_spp * sqrt_spp);
     recip_sqrt_spp = 1 / sqrt_spp;
 
+    int pass_samples = sqrt_spp * sqrt_spp;
+    total_passes = 1;
+    max_pixel_samples = pass_samples;
+    if (progressive) {
+      total_passes = std::max(1, samples_per_pixel / pass_samples);
+      max_pixel_samples = total_passes * pass_samples;
+    } else if (adaptive_sampling) {
+      max_pixel_samples = std::max(pass_samples,
+                                   max_samples_per_pixel / pass_samples * pass_samples);
+    }
+
     center = lookfrom;
 
     // Determine viewport dimensions
@@ -175,22 +458,16 @@ private:
 
   // Static method for progress tracking
 
-  static void progress_tracker(std::atomic<int> &scanlines_completed,
-                               std::atomic<bool> &rendering_complete,
-                               std::condition_variable &cv,
-                               std::mutex &cv_mutex, int image_height) {
-
-    int last_count = 0;
+  static void progress_tracker(std::atomic<int> &tiles_completed,
+                               std::atomic<bool> &rendering_complete, int tile_count) {
 
     auto start_time = steady_clock::now();
 
-    int seconds(0), minutes(0), hours(0);
-
-    while (scanlines_completed.load() < image_height) {
+    while (tiles_completed.load() < tile_count && !rendering_complete) {
 
       std::this_thread::sleep_for(milliseconds(200)); // update every 200ms
 
-      int current = scanlines_completed.load();
+      int current = tiles_completed.load();
 
       auto now = steady_clock::now();
 
@@ -200,24 +477,20 @@ private:
       int seconds = elapsed%60;
 
       if (current > 0 && elapsed > 0) {
-        
-        double scanlines_per_second = static_cast<double>(current) / seconds;
 
-        int remaining_scanlines = image_height - current;
+        int remaining_tiles = tile_count - current;
 
-        std::clog << "\rScanlines remaining: " << remaining_scanlines << " ("
-                  << static_cast<int>((current * 100.0) / image_height) << "%)"
+        std::clog << "\rTiles remaining: " << remaining_tiles << " ("
+                  << static_cast<int>((current * 100.0) / tile_count) << "%)"
                   << "\tTime: " << hours << "h" << minutes << "m" << seconds << "s" 
                   << ' ' << std::flush;
 
       } else {
 
-        std::clog << "\rScanlines remaining: " << (image_height - current)
+        std::clog << "\rTiles remaining: " << (tile_count - current)
 
                   << ' ' << std::flush;
       }
-
-      last_count = current;
     }
 
     auto end_time = steady_clock::now();
@@ -228,40 +501,215 @@ private:
               << "\nTotal time: " << elapsed_seconds;
   }
 
+  void sample_pixel(int i, int j, int pass, const hittable &world, const hittable *lights,
+                    pixel_stats &px) const {
+    // One stratified pass of sqrt_spp x sqrt_spp samples. Each pass draws its own sample
+    // indices, so the random numbers a sample uses depend only on its pixel and index.
+    int pass_samples = sqrt_spp * sqrt_spp;
+    for (int s_j = 0; s_j < sqrt_spp; s_j++) {
+      for (int s_i = 0; s_i < sqrt_spp; s_i++) {
+        seed_random(seed, uint64_t(j) * image_width + i,
+                    uint64_t(pass) * pass_samples + s_j * sqrt_spp + s_i);
+        ray r = get_ray(i, j, s_i, s_j);
+        px.add(ray_color(r, max_depth, world, lights));
+      }
+    }
+  }
+
+  void render_tile(const tile &region, const hittable &world, const hittable *lights,
+                   std::vector<pixel_stats> &stats) const {
+    int tile_width = region.x1 - region.x0;
+    int tile_height = region.y1 - region.y0;
+    stats.assign(size_t(tile_width) * tile_height, pixel_stats());
+
+    for (int j = region.y0; j < region.y1; j++) {
+      pixel_stats *row = &stats[(j - region.y0) * tile_width];
+      if (use_ray_packets)
+        render_span_packets(j, region.x0, region.x1, 0, world, lights, row, nullptr);
+      else
+        render_span(j, region.x0, region.x1, 0, world, lights, row, nullptr);
+    }
+
+    if (!adaptive_sampling)
+      return;
+
+    // Adaptive passes, judged on the neighbours within this tile.
+    std::vector<unsigned char> active(stats.size());
+    for (int pass = 1;; pass++) {
+      bool any_active = false;
+      for (int y = 0; y < tile_height; y++) {
+        for (int x = 0; x < tile_width; x++) {
+          active[y * tile_width + x] =
+              needs_more_samples(stats.data(), tile_width, tile_height, x, y);
+          any_active |= bool(active[y * tile_width + x]);
+        }
+      }
+      if (!any_active)
+        break;
+
+      for (int y = 0; y < tile_height; y++)
+        for (int x = 0; x < tile_width; x++)
+          if (active[y * tile_width + x])
+            sample_pixel(region.x0 + x, region.y0 + y, pass, world, lights,
+                         stats[y * tile_width + x]);
+    }
+  }
+
+  bool needs_more_samples(const pixel_stats *stats, int width, int height, int x,
+                          int y) const {
+    // Adaptive sampling retires a pixel once neither it nor its neighbours are still
+    // noisy, so a pixel whose first samples all missed a rare bright path (a caustic, say)
+    // keeps sampling as long as a neighbour has found it.
+    const pixel_stats &px = stats[size_t(y) * width + x];
+    if (px.count + sqrt_spp * sqrt_spp > max_pixel_samples)
+      return false;
+    if (px.count < adaptive_min_samples)
+      return true;
+
+    // Neighbours without samples belong to another shard and carry no information.
+    for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, height - 1); ny++) {
+      for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, width - 1); nx++) {
+        const pixel_stats &neighbour = stats[size_t(ny) * width + nx];
+        if (neighbour.count > 0 && neighbour.display_error() > adaptive_threshold)
+          return true;
+      }
+    }
+    return false;
+  }
+
+  void render_span(int j, int i_begin, int i_end, int pass, const hittable &world,
+                   const hittable *lights, pixel_stats *row,
+                   const unsigned char *active) const {
+    // Adds one pass of samples for pixels [i_begin, i_end) of row j to row[0, i_end -
+    // i_begin), skipping pixels whose entry in active (if given) is zero.
+    for (int i = i_begin; i < i_end; i++) {
+      if (!active || active[i - i_begin])
+        sample_pixel(i, j, pass, world, lights, row[i - i_begin]);
+    }
+  }
+
+  void render_span_packets(int j, int i_begin, int i_end, int pass, const hittable &world,
+                           const hittable *lights, pixel_stats *row,
+                           const unsigned char *active) const {
+    // Camera rays for runs of neighbouring pixels are traced as one packet. Each lane then
+    // continues as a single ray from its first hit, with its own random stream restored so
+    // that it sees the same samples it would in single-ray mode.
+    constexpr int n = ray_packet::size;
+    ray_packet packet;
+    ray rays[n];
+    rng lane_rng[n];
+    hit_record recs[n];
+
+    if (max_depth <= 0) {
+      render_span(j, i_begin, i_end, pass, world, lights, row, active);
+      return;
+    }
+
+    int pass_samples = sqrt_spp * sqrt_spp;
+
+    for (int i0 = i_begin; i0 < i_end; i0 += n) {
+      for (int s_j = 0; s_j < sqrt_spp; s_j++) {
+        for (int s_i = 0; s_i < sqrt_spp; s_i++) {
+          for (int lane = 0; lane < n; lane++) {
+            int i = i0 + lane;
+            if (i >= i_end || (active && !active[i - i_begin])) {
+              packet.clear(lane);
+              continue;
+            }
+            seed_random(seed, uint64_t(j) * image_width + i,
+                        uint64_t(pass) * pass_samples + s_j * sqrt_spp + s_i);
+            rays[lane] = get_ray(i, j, s_i, s_j);
+            lane_rng[lane] = thread_rng();
+            packet.set(lane, rays[lane], interval(0, infinity));
+          }
+
+          auto hits = world.hit_packet(packet, packet.active, recs);
+
+          for (int lane = 0; lane < n && i0 + lane < i_end; lane++) {
+            if (!ray_packet::has_lane(packet.active, lane))
+              continue;
+            thread_rng() = lane_rng[lane];
+            row[i0 + lane - i_begin].add(
+                ray_packet::has_lane(hits, lane)
+                    ? shade(rays[lane], recs[lane], max_depth, world, lights)
+                    : background);
+          }
+        }
+      }
+    }
+  }
+
   color ray_color(const ray &r, int depth, const hittable &world,
-                  const hittable &lights) const {
+                  const hittable *lights) const {
     if (depth <= 0)
       return color(0, 0, 0);
 
     hit_record rec;
 
     // If the ray htis nothing, return the background color
-    if (!world.hit(r, interval(0.001, infinity), rec))
+    if (!world.hit(r, interval(0, infinity), rec))
       return background;
 
-    scatter_record srec;
-    color color_from_emission = rec.mat->emitted(r, rec, rec.u, rec.v, rec.p);
-
-    if (!rec.mat->scatter(r, rec, srec))
-      return color_from_emission;
-    if (srec.skip_pdf) {
-            return srec.attenuation * ray_color(srec.skip_pdf_ray, depth-1, world, lights);
-        }
+    return shade(r, rec, depth, world, lights);
+  }
 
-    auto light_ptr = make_shared<hittable_pdf>(lights, rec.p);
-        mixture_pdf p(light_ptr, srec.pdf_ptr);
+  color shade(const ray &r_in, const hit_record &first_hit, int depth,
+              const hittable &world, const hittable *lights) const {
+    // Radiance arriving back along r_in from its first hit. The path is followed
+    // iteratively: radiance accumulates emission weighted by the path throughput, and
+    // after rr_min_bounces Russian roulette ends low-throughput paths early, reweighting
+    // the survivors so the estimate stays unbiased.
+    color radiance(0, 0, 0);
+    color throughput(1, 1, 1);
+    ray r = r_in;
+    hit_record rec = first_hit;
+
+    for (int bounce = 0;; bounce++) {
+      radiance += throughput * rec.mat->emitted(r, rec, rec.u, rec.v, rec.p);
+
+      scatter_record srec;
+      if (bounce + 1 >= depth || !rec.mat->scatter(r, rec, srec))
+        break;
+
+      ray scattered;
+      if (srec.skip_pdf) {
+        throughput = throughput * srec.attenuation;
+        scattered = srec.skip_pdf_ray;
+      } else if (lights) {
+        hittable_pdf light_pdf(*lights, rec.p);
+        mixture_pdf p(light_pdf, *srec.pdf_ptr());
+
+        auto direction = p.generate();
+        scattered = ray(rec.spawn_origin(direction), direction, r.time());
+        auto pdf_value = p.value(scattered.direction());
+        double scattering_pdf = rec.mat->scattering_pdf(r, rec, scattered);
+        throughput = throughput * srec.attenuation * scattering_pdf / pdf_value;
+      } else {
+        const pdf &p = *srec.pdf_ptr();
 
-        ray scattered = ray(rec.p, p.generate(), r.time());
+        auto direction = p.generate();
+        scattered = ray(rec.spawn_origin(direction), direction, r.time());
         auto pdf_value = p.value(scattered.direction());
+        double scattering_pdf = rec.mat->scattering_pdf(r, rec, scattered);
+        throughput = throughput * srec.attenuation * scattering_pdf / pdf_value;
+      }
 
-    
-    double scattering_pdf = rec.mat->scattering_pdf(r, rec, scattered);
+      if (bounce + 1 >= rr_min_bounces) {
+        auto survive = std::fmin(1.0, std::fmax(throughput.x(),
+                                                std::fmax(throughput.y(), throughput.z())));
+        if (random_double() >= survive)
+          break;
+        throughput /= survive;
+      }
 
-    color sample_color = ray_color(scattered, depth - 1, world, lights);
-    color color_from_scatter =
-        (srec.attenuation * scattering_pdf * sample_color) / pdf_value;
+      r = scattered;
+      if (!world.hit(r, interval(0, infinity), rec)) {
+        radiance += throughput * background;
+        break;
+      }
+    }
 
-    return color_from_emission + color_from_scatter;
+    return radiance;
   }
 
   ray get_ray(int i, int j) const {
@@ -14,26 +14,19 @@ inline double linear_to_gamma(double linear_component) {
     return 0;
 }
 
-inline void write_color(std::ostream &out, const color &pixel_color) {
-    auto r = pixel_color.x();
-    auto g = pixel_color.y();
-    auto b = pixel_color.z();
-
-    // Replace NaN components with zero.
-    if (r != r) r = 0.0;
-    if (g != g) g = 0.0;
-    if (b != b) b = 0.0;
-
-    // Apply a linear to gamma transform for gamma 2
-    r = linear_to_gamma(r);
-    g = linear_to_gamma(g);
-    b = linear_to_gamma(b);
+inline unsigned char color_component_to_byte(double linear_component) {
+    // Replace NaN with zero, apply a linear to gamma transform for gamma 2 and
+    // translate the [0,1] value to the byte range [0,255].
+    if (linear_component != linear_component) linear_component = 0.0;
 
-    // Translate the [0,1] component values to the byte range [0,255].
     static const interval intensity(0.000, 0.999);
-    int rbyte = int(255.999 * intensity.clamp(r));
-    int gbyte = int(255.999 * intensity.clamp(g));
-    int bbyte = int(255.999 * intensity.clamp(b));
+    return (unsigned char)(int(255.999 * intensity.clamp(linear_to_gamma(linear_component))));
+}
+
+inline void write_color(std::ostream &out, const color &pixel_color) {
+    int rbyte = color_component_to_byte(pixel_color.x());
+    int gbyte = color_component_to_byte(pixel_color.y());
+    int bbyte = color_component_to_byte(pixel_color.z());
 
     //Write out the pixel color components.
     out << rbyte << ' ' << gbyte << ' ' << bbyte << '\n';
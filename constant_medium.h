@@ -24,8 +24,12 @@ public :
         if (!boundary->hit(r, interval::universe, rec1))
             return false;
 
-        if (!boundary->hit(r, interval(rec1.t + 0.0001, infinity), rec2))
+        // The exit is found by a ray spawned through the entry point, so that it cannot
+        // find the entry again.
+        ray inside(rec1.spawn_origin(r.direction()), r.direction(), r.time());
+        if (!boundary->hit(inside, interval(0, infinity), rec2))
             return false;
+        rec2.t += rec1.t;
 
         if (rec1.t < ray_t.min) rec1.t = ray_t.min;
         if (rec2.t > ray_t.max) rec2.t = ray_t.max;
@@ -48,7 +52,8 @@ public :
 
         rec.normal = vec3(1, 0, 0); // arbitrary (?)
         rec.front_face = true; // also arbitrary (??)
-        rec.mat = phase_function;
+        rec.error_offset = vec3(0, 0, 0);   // Inside the volume, away from any surface
+        rec.mat = phase_function.get();
 
         return true;
     }
@@ -3,6 +3,7 @@
 //
 
 #include "aabb.h"
+#include "ray_packet.h"
 
 #ifndef HITTABLE_H
 #define HITTABLE_H
@@ -13,11 +14,12 @@ class hit_record {
     public:
         point3 p;
         vec3 normal;
-        shared_ptr<material> mat;
-        double t;
-        double u;
-        double v;
+        const material* mat;    // Non-owning; the primitive that was hit keeps it alive
+        real t;
+        real u;
+        real v;
         bool front_face;
+        vec3 error_offset;      // Along the geometric normal, as long as p's error bound
 
     void set_face_normal(const ray& r, const vec3& outward_normal) {
         // Sets the hit record normal vector.
@@ -26,6 +28,33 @@ class hit_record {
         front_face = dot(r.direction(), outward_normal) < 0;
         normal = front_face ? outward_normal : -outward_normal;
     }
+
+    void set_error_bound(const vec3& geometric_normal, const vec3& p_error) {
+        // Sets error_offset from the unit geometric normal and a per-axis bound on the
+        // absolute error of p: the bound on p's distance from the surface is the error
+        // projected onto the normal. An exact point, such as one on the plane z = 0, still
+        // gets a tiny distance, so that a spawned origin leaves the surface: the smallest
+        // one whose square is a normal float, so that error_offset.length() is not zero.
+        static const real min_distance = std::sqrt(std::numeric_limits<real>::min());
+        auto distance = std::fmax(dot(abs(geometric_normal), p_error), min_distance);
+        error_offset = distance * geometric_normal;
+    }
+
+    void widen_error_bound(const vec3& p_error) {
+        // Adds further per-axis error in p, e.g. from moving it into another space.
+        auto distance = error_offset.length();
+        if (distance == 0)
+            return;     // Not a surface point, e.g. scattering inside a medium
+        auto n = error_offset / distance;
+        error_offset = (distance + dot(abs(n), p_error)) * n;
+    }
+
+    point3 spawn_origin(const vec3& direction) const {
+        // Origin of a ray leaving the hit point in direction, pushed off the surface far
+        // enough that it cannot hit it again through rounding error, whatever the scale
+        // of the scene.
+        return offset_ray_origin(p, error_offset, direction);
+    }
 };
 
 class hittable {
@@ -36,6 +65,23 @@ class hittable {
     virtual bool hit(const ray& r, interval ray_t, hit_record& rec) const = 0;
         
     virtual aabb bounding_box() const = 0;
+
+    // Intersects the lanes of `rays` selected by `active`. For every lane hit, fills
+    // recs[lane] and shrinks rays.t_max[lane] to the hit distance; returns the lanes hit.
+    // The default traces the lanes one at a time through hit().
+    virtual ray_packet::lane_mask hit_packet(ray_packet& rays, ray_packet::lane_mask active,
+                                             hit_record* recs) const {
+        ray_packet::lane_mask hits = 0;
+        for (int lane = 0; lane < ray_packet::size; lane++) {
+            if (!ray_packet::has_lane(active, lane))
+                continue;
+            if (hit(rays.get(lane), rays.lane_interval(lane), recs[lane])) {
+                rays.t_max[lane] = recs[lane].t;
+                hits |= ray_packet::lane_mask(1) << lane;
+            }
+        }
+        return hits;
+    }
         
     virtual double pdf_value(const point3& origin, const vec3& direction) const {
             return 0.0;
@@ -61,8 +107,10 @@ public:
         if (!object->hit(offset_r, ray_t, rec))
             return false;
 
-        // Move the intersection point forwards by the offset
+        // Move the intersection point forwards by the offset. Both this addition and the
+        // subtraction a spawned ray's origin goes through on the way back round.
         rec.p += offset;
+        rec.widen_error_bound(rounding_gamma<real>(2) * (abs(rec.p) + abs(offset)));
 
         return true;
     }
@@ -146,6 +194,16 @@ public:
             (-sin_theta * rec.normal.x()) + (cos_theta * rec.normal.z())
         );
 
+        // The error bound turns with the normal and takes in the rounding of rotating the
+        // point here and a spawned origin on the way back.
+        rec.error_offset = vec3(
+            (cos_theta * rec.error_offset.x()) + (sin_theta * rec.error_offset.z()),
+            rec.error_offset.y(),
+            (-sin_theta * rec.error_offset.x()) + (cos_theta * rec.error_offset.z())
+        );
+        auto xz = std::fabs(rec.p.x()) + std::fabs(rec.p.z());
+        rec.widen_error_bound(rounding_gamma<real>(8) * vec3(xz, 0, xz));
+
         return true;
 
     }
@@ -27,21 +27,30 @@ public:
 
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-        hit_record temp_rec;
+        // Hittables only write rec when they report a hit, and every hit is closer than
+        // the last, so each object can fill rec directly without a temporary copy.
         bool hit_anything = false;
         auto closest_so_far = ray_t.max;
 
         for (const auto& object : objects) {
-            if (object->hit(r, interval(ray_t.min, closest_so_far), temp_rec)) {
+            if (object->hit(r, interval(ray_t.min, closest_so_far), rec)) {
                 hit_anything = true;
-                closest_so_far = temp_rec.t;
-                rec = temp_rec;
+                closest_so_far = rec.t;
             }
         }
 
         return hit_anything;
     }
 
+    ray_packet::lane_mask hit_packet(ray_packet& rays, ray_packet::lane_mask active,
+                                     hit_record* recs) const override {
+        // Each object only overwrites a lane's record when it is closer than t_max.
+        ray_packet::lane_mask hits = 0;
+        for (const auto& object : objects)
+            hits |= object->hit_packet(rays, active, recs);
+        return hits;
+    }
+
     aabb bounding_box() const override {return bbox; }
 
     double pdf_value(const point3& origin, const vec3& direction) const override {
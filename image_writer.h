@@ -0,0 +1,448 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include "color.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Rendered images are kept as linear RGB floats and handed to a binary writer once the
+// render finishes. LDR formats (PPM, PNG) are gamma-corrected and quantized on output; PFM
+// stores the linear floats unchanged for HDR post-processing.
+
+class framebuffer {
+  public:
+    framebuffer() {}
+    framebuffer(int width, int height) { resize(width, height); }
+
+    void resize(int w, int h) {
+        image_width = w;
+        image_height = h;
+        pixels.assign(size_t(w) * h * 3, 0.0f);
+    }
+
+    int width() const { return image_width; }
+    int height() const { return image_height; }
+
+    void set(int i, int j, const color& c) {
+        float* p = &pixels[(size_t(j) * image_width + i) * 3];
+        p[0] = float(c.x());
+        p[1] = float(c.y());
+        p[2] = float(c.z());
+    }
+
+    color get(int i, int j) const {
+        const float* p = &pixels[(size_t(j) * image_width + i) * 3];
+        return color(p[0], p[1], p[2]);
+    }
+
+    const float* row(int j) const { return &pixels[size_t(j) * image_width * 3]; }
+
+  private:
+    int image_width = 0;
+    int image_height = 0;
+    std::vector<float> pixels;  // Row-major RGB, top row first
+};
+
+inline void to_rgb8(const framebuffer& fb, int j, unsigned char* out) {
+    // Gamma-corrected 8-bit RGB for one row.
+    const float* p = fb.row(j);
+    for (int k = 0; k < fb.width() * 3; k++)
+        out[k] = color_component_to_byte(p[k]);
+}
+
+class image_writer {
+  public:
+    virtual ~image_writer() = default;
+
+    virtual bool write(const framebuffer& fb, std::ostream& out) const = 0;
+};
+
+class ppm_writer : public image_writer {
+  public:
+    // Binary (P6) PPM.
+    bool write(const framebuffer& fb, std::ostream& out) const override {
+        out << "P6\n" << fb.width() << ' ' << fb.height() << "\n255\n";
+
+        std::vector<unsigned char> line(size_t(fb.width()) * 3);
+        for (int j = 0; j < fb.height(); j++) {
+            to_rgb8(fb, j, line.data());
+            out.write(reinterpret_cast<const char*>(line.data()), line.size());
+        }
+        return bool(out);
+    }
+};
+
+class png_writer : public image_writer {
+  public:
+    // 8-bit RGB PNG. Each scanline takes whichever PNG filter leaves the smallest residuals,
+    // and the filtered rows are deflated with LZ77 matches and the fixed Huffman codes,
+    // which keeps the encoder self-contained and still shrinks renders several times over.
+    bool write(const framebuffer& fb, std::ostream& out) const override {
+        static const unsigned char signature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+        out.write(reinterpret_cast<const char*>(signature), 8);
+
+        unsigned char header[13];
+        put_u32(header, uint32_t(fb.width()));
+        put_u32(header + 4, uint32_t(fb.height()));
+        header[8] = 8;      // Bit depth
+        header[9] = 2;      // Color type: RGB
+        header[10] = 0;     // Compression: deflate
+        header[11] = 0;     // Filter method
+        header[12] = 0;     // No interlace
+        write_chunk(out, "IHDR", header, sizeof(header));
+
+        // Filtered scanlines: a filter type byte followed by the row's residuals.
+        const size_t row_size = size_t(fb.width()) * 3;
+        std::vector<unsigned char> previous(row_size, 0), current(row_size);
+        std::vector<unsigned char> filtered(row_size), best(row_size);
+        std::vector<unsigned char> raw;
+        raw.reserve((row_size + 1) * fb.height());
+        for (int j = 0; j < fb.height(); j++) {
+            to_rgb8(fb, j, current.data());
+            int best_type = 0;
+            long best_score = -1;
+            for (int type = 0; type < 5; type++) {
+                filter_row(type, current, previous, filtered);
+                // Residuals as signed bytes: small either side of zero compresses best.
+                long score = 0;
+                for (auto r : filtered)
+                    score += std::abs(int(int8_t(r)));
+                if (best_score < 0 || score < best_score) {
+                    best_score = score;
+                    best_type = type;
+                    best.swap(filtered);
+                }
+            }
+            raw.push_back(uint8_t(best_type));
+            raw.insert(raw.end(), best.begin(), best.end());
+            previous.swap(current);
+        }
+
+        std::vector<unsigned char> zlib = { 0x78, 0x01 };
+        deflate(raw, zlib);
+
+        unsigned char checksum[4];
+        put_u32(checksum, adler32(raw.data(), raw.size()));
+        zlib.insert(zlib.end(), checksum, checksum + 4);
+
+        write_chunk(out, "IDAT", zlib.data(), zlib.size());
+        write_chunk(out, "IEND", nullptr, 0);
+        return bool(out);
+    }
+
+  private:
+    static void filter_row(int type, const std::vector<unsigned char>& row,
+                           const std::vector<unsigned char>& above,
+                           std::vector<unsigned char>& out) {
+        // PNG filter types 0-4 (none, sub, up, average, Paeth) for 3-byte pixels. Each type
+        // has its own loop so the per-byte work stays branch-free.
+        const size_t n = row.size();
+        auto left = [&](size_t i) { return i >= 3 ? int(row[i - 3]) : 0; };
+        auto up_left = [&](size_t i) { return i >= 3 ? int(above[i - 3]) : 0; };
+        switch (type) {
+            case 0:
+                std::copy(row.begin(), row.end(), out.begin());
+                break;
+            case 1:
+                for (size_t i = 0; i < n; i++)
+                    out[i] = uint8_t(row[i] - left(i));
+                break;
+            case 2:
+                for (size_t i = 0; i < n; i++)
+                    out[i] = uint8_t(row[i] - above[i]);
+                break;
+            case 3:
+                for (size_t i = 0; i < n; i++)
+                    out[i] = uint8_t(row[i] - (left(i) + above[i]) / 2);
+                break;
+            default:
+                for (size_t i = 0; i < n; i++) {
+                    int a = left(i), b = above[i], c = up_left(i);
+                    int p = a + b - c;
+                    int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+                    int prediction = (pa <= pb && pa <= pc) ? a : (pb <= pc) ? b : c;
+                    out[i] = uint8_t(row[i] - prediction);
+                }
+                break;
+        }
+    }
+
+    static void deflate(const std::vector<unsigned char>& data, std::vector<unsigned char>& out) {
+        // One deflate block with the fixed Huffman codes (RFC 1951, 3.2.6). Matches are
+        // found through hash chains of 3-byte prefixes, taking the longest of the most
+        // recent few candidates within the 32 KiB window.
+        static const int length_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23,
+            27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+        static const int length_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+            3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+        static const int distance_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97,
+            129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289,
+            16385, 24577 };
+        static const int distance_extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+            7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+        const int window = 32768, max_match = 258, max_chain = 16, hash_bits = 15;
+        const int nice_match = 128;     // Long enough to stop searching
+
+        uint64_t bit_buffer = 0;
+        int bit_count = 0;
+        auto put_bits = [&](uint32_t value, int count) {
+            // Deflate packs values least significant bit first.
+            bit_buffer |= uint64_t(value) << bit_count;
+            bit_count += count;
+            if (bit_count >= 32) {
+                for (int k = 0; k < 4; k++)
+                    out.push_back(uint8_t(bit_buffer >> (8 * k)));
+                bit_buffer >>= 32;
+                bit_count -= 32;
+            }
+        };
+        auto reverse = [](uint32_t code, int length) {
+            // Huffman codes go most significant bit first.
+            uint32_t reversed = 0;
+            for (int k = 0; k < length; k++)
+                reversed = (reversed << 1) | ((code >> k) & 1);
+            return reversed;
+        };
+        // The fixed literal/length code of each symbol, bit-reversed, with its length.
+        static const auto symbol_codes = [&] {
+            std::vector<std::pair<uint32_t, int>> codes(288);
+            for (int symbol = 0; symbol < 288; symbol++) {
+                if (symbol < 144)      codes[symbol] = { 0x30 + symbol, 8 };
+                else if (symbol < 256) codes[symbol] = { 0x190 + symbol - 144, 9 };
+                else if (symbol < 280) codes[symbol] = { symbol - 256, 7 };
+                else                   codes[symbol] = { 0xc0 + symbol - 280, 8 };
+                codes[symbol].first = reverse(codes[symbol].first, codes[symbol].second);
+            }
+            return codes;
+        }();
+        auto put_symbol = [&](int symbol) {
+            put_bits(symbol_codes[symbol].first, symbol_codes[symbol].second);
+        };
+
+        const size_t n = data.size();
+        std::vector<int32_t> head(size_t(1) << hash_bits, -1);
+        // Previous position with the same hash, indexed by position modulo the window.
+        std::vector<int32_t> chain(window, -1);
+        auto hash = [&](size_t i) {
+            uint32_t key = (uint32_t(data[i]) << 16) | (uint32_t(data[i + 1]) << 8) | data[i + 2];
+            return (key * 2654435761u) >> (32 - hash_bits);
+        };
+        auto insert = [&](size_t i) {
+            if (i + 3 > n)
+                return;
+            auto h = hash(i);
+            chain[i & (window - 1)] = head[h];
+            head[h] = int32_t(i);
+        };
+
+        const size_t start = out.size();
+        out.reserve(start + n + n / 8 + 16);
+        put_bits(1, 1);     // Final block
+        put_bits(1, 2);     // Fixed Huffman codes
+
+        size_t i = 0;
+        while (i < n) {
+            int best_length = 0, best_distance = 0;
+            if (i + 3 <= n) {
+                const int limit = int(std::min(size_t(max_match), n - i));
+                int32_t candidate = head[hash(i)];
+                for (int tries = 0; candidate >= 0 && int(i - candidate) <= window
+                                    && tries < max_chain; tries++) {
+                    // A candidate can only do better if it matches the byte that ended
+                    // the best match so far.
+                    if (data[candidate + best_length] == data[i + best_length]) {
+                        int length = 0;
+                        while (length < limit && data[candidate + length] == data[i + length])
+                            length++;
+                        if (length > best_length) {
+                            best_length = length;
+                            best_distance = int(i - candidate);
+                            if (length >= std::min(nice_match, limit))
+                                break;
+                        }
+                    }
+                    candidate = chain[candidate & (window - 1)];
+                }
+            }
+
+            if (best_length < 3) {
+                put_symbol(data[i]);
+                insert(i++);
+                continue;
+            }
+
+            int code = 28;
+            while (length_base[code] > best_length)
+                code--;
+            put_symbol(257 + code);
+            put_bits(uint32_t(best_length - length_base[code]), length_extra[code]);
+
+            code = 29;
+            while (distance_base[code] > best_distance)
+                code--;
+            put_bits(reverse(uint32_t(code), 5), 5);
+            put_bits(uint32_t(best_distance - distance_base[code]), distance_extra[code]);
+
+            for (int k = 0; k < best_length; k++)
+                insert(i++);
+        }
+
+        put_symbol(256);    // End of block
+        for (; bit_count > 0; bit_count -= 8, bit_buffer >>= 8)
+            out.push_back(uint8_t(bit_buffer));
+
+        // Data that does not compress, such as pure noise, grows under the fixed codes;
+        // store it instead, in blocks of up to 65535 bytes.
+        const size_t stored_size = n + 5 * std::max<size_t>(1, (n + 65534) / 65535);
+        if (out.size() - start <= stored_size)
+            return;
+        out.resize(start);
+        size_t p = 0;
+        do {
+            const size_t length = std::min<size_t>(65535, n - p);
+            out.push_back(p + length == n ? 1 : 0);     // Final block flag, stored type
+            out.push_back(uint8_t(length));
+            out.push_back(uint8_t(length >> 8));
+            out.push_back(uint8_t(~length));
+            out.push_back(uint8_t(~length >> 8));
+            out.insert(out.end(), data.begin() + p, data.begin() + p + length);
+            p += length;
+        } while (p < n);
+    }
+
+    static void put_u32(unsigned char* p, uint32_t v) {
+        p[0] = uint8_t(v >> 24);
+        p[1] = uint8_t(v >> 16);
+        p[2] = uint8_t(v >> 8);
+        p[3] = uint8_t(v);
+    }
+
+    static uint32_t crc32(uint32_t crc, const unsigned char* data, size_t size) {
+        static const auto table = [] {
+            std::vector<uint32_t> t(256);
+            for (uint32_t n = 0; n < 256; n++) {
+                uint32_t c = n;
+                for (int k = 0; k < 8; k++)
+                    c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                t[n] = c;
+            }
+            return t;
+        }();
+
+        crc = ~crc;
+        for (size_t i = 0; i < size; i++)
+            crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    static uint32_t adler32(const unsigned char* data, size_t size) {
+        uint32_t a = 1, b = 0;
+        while (size > 0) {
+            // 5552 is the largest run that cannot overflow b before the modulo.
+            size_t run = std::min(size, size_t(5552));
+            for (size_t i = 0; i < run; i++) {
+                a += data[i];
+                b += a;
+            }
+            a %= 65521;
+            b %= 65521;
+            data += run;
+            size -= run;
+        }
+        return (b << 16) | a;
+    }
+
+    static void write_chunk(std::ostream& out, const char type[4], const unsigned char* data,
+                            size_t size) {
+        unsigned char length[4];
+        put_u32(length, uint32_t(size));
+        out.write(reinterpret_cast<const char*>(length), 4);
+        out.write(type, 4);
+        if (size > 0)
+            out.write(reinterpret_cast<const char*>(data), size);
+
+        auto crc = crc32(0, reinterpret_cast<const unsigned char*>(type), 4);
+        crc = crc32(crc, data, size);
+        unsigned char checksum[4];
+        put_u32(checksum, crc);
+        out.write(reinterpret_cast<const char*>(checksum), 4);
+    }
+};
+
+class pfm_writer : public image_writer {
+  public:
+    // Portable float map: linear 32-bit RGB in host byte order, rows stored bottom to top.
+    // A negative scale in the header marks little-endian data.
+    bool write(const framebuffer& fb, std::ostream& out) const override {
+        const uint16_t probe = 1;
+        bool little_endian = *reinterpret_cast<const unsigned char*>(&probe) == 1;
+        out << "PF\n" << fb.width() << ' ' << fb.height() << '\n'
+            << (little_endian ? "-1.0" : "1.0") << '\n';
+
+        std::vector<float> line(size_t(fb.width()) * 3);
+        for (int j = fb.height() - 1; j >= 0; j--) {
+            const float* p = fb.row(j);
+            for (size_t k = 0; k < line.size(); k++)
+                line[k] = (p[k] == p[k]) ? p[k] : 0.0f;
+            out.write(reinterpret_cast<const char*>(line.data()), line.size() * sizeof(float));
+        }
+        return bool(out);
+    }
+};
+
+inline std::unique_ptr<image_writer> make_image_writer(const std::string& path) {
+    // Picks the writer from the file extension; anything unrecognised is written as PPM.
+    auto dot = path.rfind('.');
+    std::string ext = (dot == std::string::npos) ? "" : path.substr(dot + 1);
+    for (auto& c : ext)
+        c = char(std::tolower((unsigned char)c));
+
+    if (ext == "png")
+        return std::make_unique<png_writer>();
+    if (ext == "pfm")
+        return std::make_unique<pfm_writer>();
+    return std::make_unique<ppm_writer>();
+}
+
+inline bool write_image(const framebuffer& fb, const std::string& path) {
+    // An empty path writes binary PPM to stdout. Files are written under a temporary name
+    // and renamed into place, so a reader never sees a half-written image; progressive
+    // renders rewrite the same file at every checkpoint.
+    if (path.empty())
+        return ppm_writer().write(fb, std::cout);
+
+    std::string temp_path = path + ".tmp";
+    {
+        // Closing flushes the buffered tail of the file, which can still fail (a full
+        // disk), so the stream is only checked once it is closed.
+        std::ofstream out(temp_path, std::ios::binary);
+        bool written = out && make_image_writer(path)->write(fb, out);
+        out.close();
+        if (!written || !out) {
+            std::cerr << "ERROR: Could not write '" << temp_path << "'.\n";
+            std::remove(temp_path.c_str());
+            return false;
+        }
+    }
+
+    if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        // Some platforms will not rename over an existing file.
+        std::remove(path.c_str());
+        if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+            std::cerr << "ERROR: Could not rename '" << temp_path << "' to '" << path << "'.\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif //IMAGE_WRITER_H
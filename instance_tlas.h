@@ -0,0 +1,103 @@
+#ifndef INSTANCE_TLAS_H
+#define INSTANCE_TLAS_H
+
+#include "hittable.h"
+#include "linear_bvh.h"
+#include "transform.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// A two-level acceleration structure. Each unique piece of geometry (a mesh, or a group
+// under its own linear_bvh) is a bottom-level structure built once; the top level is a
+// linear BVH over instances, each of which places a bottom-level structure with a 3x4
+// affine transform. An instance stores its transform, the inverse and a geometry index,
+// so thousands of copies cost about 230 bytes each plus their share of the top-level
+// tree, whatever the size of the geometry they place. Instances are intersected the same
+// way as a transform.
+
+class instance_tlas : public hittable {
+  public:
+    instance_tlas() {}
+
+    void add(shared_ptr<hittable> geometry, const affine& object_to_world) {
+        // Adds a copy of geometry placed by object_to_world, which must be invertible.
+        auto [entry, inserted] = geometry_index.try_emplace(geometry.get(),
+                                                            uint32_t(geometries.size()));
+        if (inserted)
+            geometries.push_back(geometry);
+        instances.push_back({ object_to_world, object_to_world.inverse(), entry->second });
+        instance_bounds.push_back(transform::transformed_bounds(*geometry, object_to_world));
+    }
+
+    void build(const bvh_build_options& options = {}) {
+        // Builds the top level over the instances added so far.
+        std::vector<uint32_t> order;
+        bvh_builder::build(instance_bounds, options, nodes, order);
+
+        bbox = aabb::empty;
+        std::vector<instance> ordered;
+        ordered.reserve(instances.size());
+        for (auto index : order) {
+            ordered.push_back(instances[index]);
+            bbox = aabb(bbox, instance_bounds[index]);
+        }
+        instances.swap(ordered);
+        std::vector<aabb>().swap(instance_bounds);
+        geometry_index.clear();
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        if (nodes.empty())
+            return false;
+
+        // The record stays in object space until the closest instance is known, and only
+        // that one is moved to world space.
+        const instance* closest = nullptr;
+        bool hit_anything = traverse_linear_bvh(nodes.data(), r, ray_t,
+            [&](uint32_t first, uint32_t count, interval& t) {
+                bool hit_leaf = false;
+                for (uint32_t i = first; i < first + count; i++) {
+                    const auto& inst = instances[i];
+                    if (transform::hit_object(*geometries[inst.geometry], inst.world_to_object,
+                                              r, t, rec)) {
+                        hit_leaf = true;
+                        closest = &inst;
+                        t.max = rec.t;
+                    }
+                }
+                return hit_leaf;
+            });
+        if (hit_anything)
+            transform::to_world(closest->object_to_world, closest->world_to_object, rec);
+        return hit_anything;
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    size_t instance_count() const { return instances.size(); }
+    size_t geometry_count() const { return geometries.size(); }
+
+    size_t memory_bytes() const {
+        // Heap memory of the top level; the geometry it places is not counted.
+        return instances.capacity() * sizeof(instance) + nodes.capacity() * sizeof(linear_bvh_node)
+             + geometries.capacity() * sizeof(shared_ptr<hittable>);
+    }
+
+  private:
+    struct instance {
+        affine object_to_world;
+        affine world_to_object;
+        uint32_t geometry;
+    };
+
+    std::vector<shared_ptr<hittable>> geometries;
+    std::unordered_map<const hittable*, uint32_t> geometry_index;   // Only while adding
+    std::vector<instance> instances;        // In leaf order once built
+    std::vector<aabb> instance_bounds;      // Only while adding
+    std::vector<linear_bvh_node> nodes;
+    aabb bbox = aabb::empty;
+};
+
+#endif //INSTANCE_TLAS_H
@@ -6,51 +6,62 @@
 #define INTERVAL_H
 #include "rtweekend.h"
 
-class interval {
+template <typename T>
+class basic_interval {
 public:
-    double min, max;
-    interval() : min(+infinity), max(-infinity) {} // Default interval is empty
-    interval(double min, double max) : min(min), max(max) {}
-
-    interval(const interval& a, const interval& b) {
-        // Create the interval tightly enclosing the two input intervals.
-        min = a.min <= b.min ? a.min : b.min;
-        max = a.max >= b.max ? a.max : b.max;
-    }
+    using value_type = T;
+
+    T min, max;
+    constexpr basic_interval() : min(+infinity), max(-infinity) {} // Default interval is empty
+    constexpr basic_interval(T min, T max) : min(min), max(max) {}
 
-    double size() const {
+    constexpr basic_interval(const basic_interval& a, const basic_interval& b)
+      // Create the interval tightly enclosing the two input intervals.
+      : min(a.min <= b.min ? a.min : b.min), max(a.max >= b.max ? a.max : b.max) {}
+
+    constexpr T size() const {
         return max-min;
     }
 
-    bool contains(double x) const {
+    bool contains(T x) const {
         return min <= x && x <= max;
     }
-    bool surrounds(double x) const {
+    bool surrounds(T x) const {
         return min < x && x < max;
     }
 
-    double clamp(double x) const {
+    T clamp(T x) const {
         if (x < min) return min;
         if (x > max) return max;
         return x;
     }
 
-    interval expand(double delta) const {
+    constexpr basic_interval expand(T delta) const {
         auto padding = delta/2;
-        return interval(min - padding, max + padding);
+        return basic_interval(min - padding, max + padding);
     }
 
-    static const interval empty, universe;
+    // The class is incomplete here, so these are defined constexpr below; being constant
+    // initialized, they are ready before any dynamic initializer (such as aabb's) runs.
+    static const basic_interval empty, universe;
 };
 
-const interval interval::empty = interval(+infinity, -infinity);
-const interval interval::universe = interval(-infinity, +infinity);
+template <typename T>
+constexpr basic_interval<T> basic_interval<T>::empty = basic_interval<T>(+infinity, -infinity);
+template <typename T>
+constexpr basic_interval<T> basic_interval<T>::universe = basic_interval<T>(-infinity, +infinity);
+
+using interval = basic_interval<real>;
 
-interval operator+(const interval& ival, double displacement) {
-    return interval(ival.min + displacement, ival.max + displacement);
+template <typename T>
+basic_interval<T> operator+(const basic_interval<T>& ival,
+                            typename basic_interval<T>::value_type displacement) {
+    return basic_interval<T>(ival.min + displacement, ival.max + displacement);
 }
 
-interval operator+(double displacement, const interval& ival) {
+template <typename T>
+basic_interval<T> operator+(typename basic_interval<T>::value_type displacement,
+                            const basic_interval<T>& ival) {
     return ival + displacement;
 }
 #endif //INTERVAL_H
@@ -0,0 +1,474 @@
+#ifndef LINEAR_BVH_H
+#define LINEAR_BVH_H
+
+#include "aabb.h"
+#include "hittable.h"
+#include "hittable_list.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// A BVH compiled into one contiguous array. Nodes are laid out depth first, so the first
+// child of an interior node is always the next node in the array and only the second child
+// needs an offset. Leaves index a contiguous range of the primitive array.
+
+struct linear_bvh_node {
+    float bounds_min[3];    // Rounded outward from the full-precision bounds
+    float bounds_max[3];
+    uint32_t offset;        // Leaf: first primitive index. Interior: second child index.
+    uint16_t prim_count;    // 0 for interior nodes
+    uint8_t axis;           // Split axis of interior nodes, used for near-child-first order
+    uint8_t pad;
+
+    bool is_leaf() const { return prim_count > 0; }
+
+    aabb bounds() const {
+        return aabb(interval(bounds_min[0], bounds_max[0]),
+                    interval(bounds_min[1], bounds_max[1]),
+                    interval(bounds_min[2], bounds_max[2]));
+    }
+
+    bool hit(const ray& r, const interval& ray_t) const {
+        // Same branchless slab test as aabb::hit, using the ray's cached reciprocal
+        // direction and sign bits.
+        const point3& orig = r.origin();
+        const vec3& inv_dir = r.inv_direction();
+        auto t_min = ray_t.min;
+        auto t_max = ray_t.max;
+
+        for (int axis = 0; axis < 3; axis++) {
+            bool neg = r.dir_is_neg(axis);
+            auto t_near = ((neg ? bounds_max[axis] : bounds_min[axis]) - orig[axis]) * inv_dir[axis];
+            auto t_far = ((neg ? bounds_min[axis] : bounds_max[axis]) - orig[axis]) * inv_dir[axis];
+            t_min = t_near > t_min ? t_near : t_min;
+            t_max = t_far < t_max ? t_far : t_max;
+        }
+
+        return t_min < t_max;
+    }
+};
+
+static_assert(sizeof(linear_bvh_node) == 32, "linear_bvh_node should fill half a cache line");
+
+// Deepest tree the builder will produce; traversal stacks are sized to match.
+constexpr int linear_bvh_max_depth = 64;
+
+enum class bvh_split_method {
+    median,     // Object-count median along the longest centroid axis
+    sah         // Binned surface area heuristic
+};
+
+struct bvh_build_options {
+    bvh_split_method method = bvh_split_method::median;
+    int max_leaf_size = 4;          // Spans this small always become leaves
+    int bin_count = 16;             // SAH candidate split planes per axis are bin_count - 1
+    double traversal_cost = 1.0;    // Relative cost of visiting an interior node
+    double intersection_cost = 1.0; // Relative cost of one primitive intersection
+};
+
+class bvh_builder {
+  public:
+    // Builds a BVH over arbitrary primitives given only their bounding boxes. On return
+    // `order` maps each leaf slot to the index of the primitive in `prim_bounds`.
+
+    static void build(const std::vector<aabb>& prim_bounds, const bvh_build_options& options,
+                      std::vector<linear_bvh_node>& nodes, std::vector<uint32_t>& order) {
+        nodes.clear();
+        order.resize(prim_bounds.size());
+        if (prim_bounds.empty())
+            return;
+
+        std::vector<point3> centroids(prim_bounds.size());
+        for (size_t i = 0; i < prim_bounds.size(); i++) {
+            order[i] = uint32_t(i);
+            centroids[i] = centroid(prim_bounds[i]);
+        }
+
+        auto opts = options;
+        opts.max_leaf_size = std::clamp(opts.max_leaf_size, 1, int(max_prims_per_leaf));
+        opts.bin_count = std::max(2, opts.bin_count);
+
+        nodes.reserve(2 * prim_bounds.size() / opts.max_leaf_size + 1);
+        bvh_builder builder(prim_bounds, centroids, opts, nodes, order);
+        builder.build_recursive(0, prim_bounds.size(), 0);
+    }
+
+    static double sah_cost(const std::vector<linear_bvh_node>& nodes,
+                           const bvh_build_options& options) {
+        // Expected cost of a random ray through the tree, relative to the root bounds:
+        // traversal_cost for every interior node visited plus intersection_cost for every
+        // primitive tested, each weighted by the probability the ray enters that node.
+        if (nodes.empty())
+            return 0;
+
+        auto root_area = surface_area(nodes[0].bounds());
+        if (root_area <= 0)
+            return 0;
+
+        double cost = 0;
+        for (const auto& node : nodes) {
+            auto probability = surface_area(node.bounds()) / root_area;
+            cost += node.is_leaf() ? probability * node.prim_count * options.intersection_cost
+                                   : probability * options.traversal_cost;
+        }
+        return cost;
+    }
+
+    static point3 centroid(const aabb& box) {
+        return point3(0.5 * (box.x.min + box.x.max),
+                      0.5 * (box.y.min + box.y.max),
+                      0.5 * (box.z.min + box.z.max));
+    }
+
+  private:
+    const std::vector<aabb>& prim_bounds;
+    const std::vector<point3>& centroids;
+    bvh_build_options options;
+    std::vector<linear_bvh_node>& nodes;
+    std::vector<uint32_t>& order;
+
+    static constexpr size_t max_prims_per_leaf = UINT16_MAX;
+
+    struct sah_bin {
+        aabb bounds = aabb::empty;
+        size_t count = 0;
+    };
+
+    bvh_builder(const std::vector<aabb>& prim_bounds, const std::vector<point3>& centroids,
+                const bvh_build_options& options, std::vector<linear_bvh_node>& nodes,
+                std::vector<uint32_t>& order)
+      : prim_bounds(prim_bounds), centroids(centroids), options(options),
+        nodes(nodes), order(order) {}
+
+    uint32_t build_recursive(size_t start, size_t end, int depth) {
+        auto node_index = uint32_t(nodes.size());
+        nodes.emplace_back();
+
+        aabb bbox = aabb::empty;
+        interval centroid_bounds[3];
+        for (size_t i = start; i < end; i++) {
+            bbox = aabb(bbox, prim_bounds[order[i]]);
+            const auto& c = centroids[order[i]];
+            for (int a = 0; a < 3; a++)
+                centroid_bounds[a] = interval(centroid_bounds[a], interval(c[a], c[a]));
+        }
+
+        set_bounds(nodes[node_index], bbox);
+
+        size_t object_span = end - start;
+        int axis = longest_axis(centroid_bounds);
+
+        // Coincident centroids cannot be separated by any split plane.
+        if (object_span <= size_t(options.max_leaf_size) || centroid_bounds[axis].size() <= 0) {
+            if (object_span <= max_prims_per_leaf) {
+                make_leaf(nodes[node_index], start, object_span);
+                return node_index;
+            }
+        }
+
+        size_t mid = end;
+
+        // SAH trees can be unbalanced; switch to median splits before the subtree could
+        // outgrow the traversal stack.
+        bool sah = options.method == bvh_split_method::sah
+                && depth + ceil_log2(object_span) + 2 < linear_bvh_max_depth;
+
+        if (sah) {
+            if (!sah_split(start, end, bbox, centroid_bounds, axis, mid)) {
+                make_leaf(nodes[node_index], start, object_span);
+                return node_index;
+            }
+        }
+
+        if (mid == start || mid == end) {
+            // Split at the object-count median along the longest axis of the centroid bounds.
+            mid = start + object_span/2;
+            std::nth_element(order.begin() + start, order.begin() + mid, order.begin() + end,
+                [&](uint32_t a, uint32_t b) { return centroids[a][axis] < centroids[b][axis]; });
+        }
+
+        build_recursive(start, mid, depth + 1);
+        auto second_child = build_recursive(mid, end, depth + 1);
+
+        auto& node = nodes[node_index];
+        node.offset = second_child;
+        node.prim_count = 0;
+        node.axis = uint8_t(axis);
+        return node_index;
+    }
+
+    bool sah_split(size_t start, size_t end, const aabb& bbox, const interval centroid_bounds[3],
+                   int& axis, size_t& mid) {
+        // Bins the centroids along every axis and picks the cheapest bin boundary. Returns
+        // false when a leaf is cheaper than any split; otherwise partitions [start, end) and
+        // sets the split axis and mid. mid is left at end if no boundary separates anything.
+
+        const int bin_count = options.bin_count;
+        const size_t object_span = end - start;
+        const double leaf_cost = options.intersection_cost * double(object_span);
+        const double inv_area = 1.0 / surface_area(bbox);
+
+        std::vector<sah_bin> bins(bin_count);
+        std::vector<double> right_cost(bin_count);
+
+        double best_cost = infinity;
+        int best_axis = -1;
+        int best_split = 0;
+
+        for (int a = 0; a < 3; a++) {
+            const auto& extent = centroid_bounds[a];
+            if (extent.size() <= 0)
+                continue;
+
+            std::fill(bins.begin(), bins.end(), sah_bin{});
+            const double scale = bin_count / extent.size();
+            for (size_t i = start; i < end; i++) {
+                auto b = bin_index(centroids[order[i]][a], extent.min, scale);
+                bins[b].bounds = aabb(bins[b].bounds, prim_bounds[order[i]]);
+                bins[b].count++;
+            }
+
+            // Sweep from the right to cost everything above each boundary, then from the left.
+            aabb right_bounds = aabb::empty;
+            size_t right_count = 0;
+            for (int b = bin_count - 1; b > 0; b--) {
+                right_bounds = aabb(right_bounds, bins[b].bounds);
+                right_count += bins[b].count;
+                right_cost[b] = right_count ? right_count * surface_area(right_bounds) : 0;
+            }
+
+            aabb left_bounds = aabb::empty;
+            size_t left_count = 0;
+            for (int b = 0; b < bin_count - 1; b++) {
+                left_bounds = aabb(left_bounds, bins[b].bounds);
+                left_count += bins[b].count;
+                if (left_count == 0 || left_count == object_span)
+                    continue;
+
+                double cost = options.traversal_cost + options.intersection_cost * inv_area
+                            * (left_count * surface_area(left_bounds) + right_cost[b + 1]);
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = a;
+                    best_split = b;
+                }
+            }
+        }
+
+        if (best_axis < 0)
+            return true;
+
+        // Spans up to max_leaf_size never get here; larger ones become leaves too when that is
+        // cheaper, as far as a leaf can hold them.
+        if (best_cost >= leaf_cost && object_span <= max_prims_per_leaf)
+            return false;
+
+        axis = best_axis;
+        const auto& extent = centroid_bounds[axis];
+        const double scale = bin_count / extent.size();
+        auto split = std::partition(order.begin() + start, order.begin() + end,
+            [&](uint32_t i) { return bin_index(centroids[i][axis], extent.min, scale) <= best_split; });
+        mid = size_t(split - order.begin());
+        return true;
+    }
+
+    int bin_index(double c, double min, double scale) const {
+        auto b = int((c - min) * scale);
+        return std::clamp(b, 0, options.bin_count - 1);
+    }
+
+    static double surface_area(const aabb& box) {
+        auto dx = box.x.size(), dy = box.y.size(), dz = box.z.size();
+        return 2 * (dx*dy + dy*dz + dz*dx);
+    }
+
+    static int ceil_log2(size_t n) {
+        int log = 0;
+        while ((size_t(1) << log) < n)
+            log++;
+        return log;
+    }
+
+    static int longest_axis(const interval bounds[3]) {
+        if (bounds[0].size() > bounds[1].size())
+            return bounds[0].size() > bounds[2].size() ? 0 : 2;
+        else
+            return bounds[1].size() > bounds[2].size() ? 1 : 2;
+    }
+
+    static void make_leaf(linear_bvh_node& node, size_t first, size_t count) {
+        node.offset = uint32_t(first);
+        node.prim_count = uint16_t(count);
+        node.axis = 0;
+    }
+
+    static void set_bounds(linear_bvh_node& node, const aabb& box) {
+        for (int axis = 0; axis < 3; axis++) {
+            node.bounds_min[axis] = round_down(box.axis_interval(axis).min);
+            node.bounds_max[axis] = round_up(box.axis_interval(axis).max);
+        }
+        node.pad = 0;
+    }
+
+    static float round_down(double x) {
+        auto f = float(x);
+        return (double(f) > x) ? std::nextafter(f, -std::numeric_limits<float>::infinity()) : f;
+    }
+
+    static float round_up(double x) {
+        auto f = float(x);
+        return (double(f) < x) ? std::nextafter(f, std::numeric_limits<float>::infinity()) : f;
+    }
+};
+
+inline void flatten_hittables(const shared_ptr<hittable>& object,
+                              std::vector<shared_ptr<hittable>>& objects) {
+    // Nested lists (e.g. the six sides returned by box()) are pulled up so that each
+    // primitive gets its own leaf slot instead of being tested as one opaque group.
+    if (auto list = std::dynamic_pointer_cast<hittable_list>(object)) {
+        for (const auto& child : list->objects)
+            flatten_hittables(child, objects);
+    } else {
+        objects.push_back(object);
+    }
+}
+
+template <typename LeafHit>
+bool traverse_linear_bvh(const linear_bvh_node* nodes, const ray& r, interval ray_t,
+                         LeafHit&& leaf_hit) {
+    // Walks the flattened tree with an explicit stack, visiting the child on the near side
+    // of the split plane first. leaf_hit(first, count, ray_t) tests a primitive range,
+    // returns true on a hit and shrinks ray_t.max to the closest hit so far.
+
+    uint32_t stack[linear_bvh_max_depth];
+    int stack_size = 0;
+    uint32_t current = 0;
+    bool hit_anything = false;
+
+    while (true) {
+        const auto& node = nodes[current];
+
+        if (node.hit(r, ray_t)) {
+            if (node.is_leaf()) {
+                if (leaf_hit(node.offset, node.prim_count, ray_t))
+                    hit_anything = true;
+                if (stack_size == 0) break;
+                current = stack[--stack_size];
+            } else if (r.dir_is_neg(node.axis)) {
+                stack[stack_size++] = current + 1;
+                current = node.offset;
+            } else {
+                stack[stack_size++] = node.offset;
+                current = current + 1;
+            }
+        } else {
+            if (stack_size == 0) break;
+            current = stack[--stack_size];
+        }
+    }
+
+    return hit_anything;
+}
+
+class linear_bvh : public hittable {
+  public:
+    linear_bvh(const hittable_list& list, const bvh_build_options& options = {})
+      : options(options) {
+        for (const auto& object : list.objects)
+            flatten_hittables(object, objects);
+
+        std::vector<aabb> prim_bounds;
+        prim_bounds.reserve(objects.size());
+        bbox = aabb::empty;
+        for (const auto& object : objects) {
+            prim_bounds.push_back(object->bounding_box());
+            bbox = aabb(bbox, prim_bounds.back());
+        }
+
+        std::vector<uint32_t> order;
+        bvh_builder::build(prim_bounds, options, nodes, order);
+
+        primitives.reserve(order.size());
+        for (auto index : order)
+            primitives.push_back(objects[index].get());
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        if (nodes.empty())
+            return false;
+
+        return traverse_linear_bvh(nodes.data(), r, ray_t,
+            [&](uint32_t first, uint32_t count, interval& t) {
+                bool hit_leaf = false;
+                for (uint32_t i = first; i < first + count; i++) {
+                    if (primitives[i]->hit(r, t, rec)) {
+                        hit_leaf = true;
+                        t.max = rec.t;
+                    }
+                }
+                return hit_leaf;
+            });
+    }
+
+    ray_packet::lane_mask hit_packet(ray_packet& rays, ray_packet::lane_mask active,
+                                     hit_record* recs) const override {
+        // Traverses the tree once for the whole packet. A node is entered if any live lane
+        // overlaps it, and the near child is chosen from the first live lane's direction,
+        // which is right for the whole packet when its rays are coherent.
+        if (nodes.empty() || active == 0)
+            return 0;
+
+        int first = 0;
+        while (!ray_packet::has_lane(active, first))
+            first++;
+        const bool dir_is_neg[3] = { rays.dx[first] < 0, rays.dy[first] < 0, rays.dz[first] < 0 };
+
+        uint32_t stack[linear_bvh_max_depth];
+        int stack_size = 0;
+        uint32_t current = 0;
+        ray_packet::lane_mask hits = 0;
+
+        while (true) {
+            const auto& node = nodes[current];
+            auto node_lanes = active & packet_box_hit(rays, node.bounds_min, node.bounds_max);
+
+            if (node_lanes) {
+                if (node.is_leaf()) {
+                    for (uint32_t i = node.offset; i < node.offset + node.prim_count; i++)
+                        hits |= primitives[i]->hit_packet(rays, node_lanes, recs);
+                    if (stack_size == 0) break;
+                    current = stack[--stack_size];
+                } else if (dir_is_neg[node.axis]) {
+                    stack[stack_size++] = current + 1;
+                    current = node.offset;
+                } else {
+                    stack[stack_size++] = node.offset;
+                    current = current + 1;
+                }
+            } else {
+                if (stack_size == 0) break;
+                current = stack[--stack_size];
+            }
+        }
+
+        return hits;
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    size_t node_count() const { return nodes.size(); }
+    size_t primitive_count() const { return primitives.size(); }
+
+    // SAH cost of the built tree under the cost model it was built with.
+    double sah_cost() const { return bvh_builder::sah_cost(nodes, options); }
+
+  private:
+    bvh_build_options options;
+    std::vector<shared_ptr<hittable>> objects;  // Owns the primitives
+    std::vector<const hittable*> primitives;    // Leaf order; leaves index into this array
+    std::vector<linear_bvh_node> nodes;
+    aabb bbox;
+};
+
+#endif //LINEAR_BVH_H
@@ -63,5 +63,5 @@ int main() {
 
   cam.defocus_angle = 0;
 
-  cam.render(world, lights);
+  return cam.render(world, lights) ? 0 : 1;
 }
@@ -1,13 +1,92 @@
 #include "rtweekend.h"
 
 #include "bvh.h"
+#include "linear_bvh.h"
 #include "camera.h"
 #include "constant_medium.h"
 #include "hittable_list.h"
 #include "sphere.h"
+#include "sphere_set.h"
 #include "quad.h"
+#include "render_shard.h"
+#include "scene_loader.h"
+#include "transform.h"
+
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+
+// Settings from the command line, applied to the camera of whichever scene is rendered.
+struct render_options {
+    std::string output_file = "image.png";
+    int pass_samples = 0;       // > 0 renders progressively in passes of this many samples
+    int workers = 0;            // > 1 forks this many local shard workers, then merges
+    int shard_index = 0;
+    int shard_count = 1;
+    shard_split shard_mode = shard_split::regions;
+    std::string shard_file;
+    int image_width = 0;        // Overrides for the scene's own settings, when > 0
+    int samples_per_pixel = 0;
+    int max_depth = 0;
+    bool override_seed = false;
+    uint64_t seed = 0;
+    std::string scene_cache;    // Binary cache for the scene file, reused while it is current
+    std::string checkpoint_file; // Progressive state saved at each checkpoint, for resuming
+    bool resume = false;        // Continue from checkpoint_file if it matches the settings
+    int checkpoint_passes = 0;  // Progressive checkpoint and budget overrides, when > 0
+    double checkpoint_seconds = 0;
+    double time_budget_seconds = 0;
+    bool adaptive_sampling = false;
+    double adaptive_threshold = 0;      // Adaptive sampling overrides, when > 0
+    int max_samples_per_pixel = 0;
+    std::string sample_count_file;
+    bool ray_packets = false;
+
+    void apply(camera& cam) const {
+        cam.output_file = output_file;
+        if (image_width > 0)       cam.image_width = image_width;
+        if (samples_per_pixel > 0) cam.samples_per_pixel = samples_per_pixel;
+        if (max_depth > 0)         cam.max_depth = max_depth;
+        if (override_seed)         cam.seed = seed;
+        if (adaptive_sampling)     cam.adaptive_sampling = true;
+        if (adaptive_threshold > 0)    cam.adaptive_threshold = adaptive_threshold;
+        if (max_samples_per_pixel > 0) cam.max_samples_per_pixel = max_samples_per_pixel;
+        if (!sample_count_file.empty()) cam.sample_count_file = sample_count_file;
+        if (ray_packets)           cam.use_ray_packets = true;
+
+        // Checkpoints and time budgets only apply to progressive renders.
+        if (checkpoint_passes > 0 || checkpoint_seconds > 0 || time_budget_seconds > 0)
+            cam.progressive = true;
+        if (checkpoint_passes > 0)   cam.checkpoint_passes = checkpoint_passes;
+        if (checkpoint_seconds > 0)  cam.checkpoint_seconds = checkpoint_seconds;
+        if (time_budget_seconds > 0) cam.time_budget_seconds = time_budget_seconds;
+        if (pass_samples > 0) {
+            cam.progressive = true;
+            cam.progressive_pass_samples = pass_samples;
+        }
+        if (!checkpoint_file.empty()) {
+            // Only progressive renders have state to save.
+            cam.progressive = true;
+            cam.checkpoint_file = checkpoint_file;
+            cam.resume = resume;
+            if (cam.checkpoint_passes == 0 && cam.checkpoint_seconds == 0)
+                cam.checkpoint_passes = 1;  // Lose at most one pass to preemption
+        }
+        cam.shard_index = shard_index;
+        cam.shard_count = shard_count;
+        cam.shard_mode = shard_mode;
+        cam.shard_file = shard_file;
+    }
+};
 
-void bouncing_spheres() {
+render_options options;
+std::string scene_file;         // Scene description to load instead of a built-in scene
+
+bool bouncing_spheres() {
    hittable_list world;
 
     auto ground_material = make_shared<lambertian>(color(0.5, 0.5, 0.5));
@@ -55,7 +134,7 @@ void bouncing_spheres() {
     auto material3 = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
     world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
 
-    world = hittable_list(make_shared<bvh_node>(world));
+    world = hittable_list(make_shared<linear_bvh>(world));
 
     camera cam;
 
@@ -73,10 +152,11 @@ void bouncing_spheres() {
     cam.defocus_angle = 0.6;
     cam.focus_dist = 10.0;
 
-    cam.render(world);
+    options.apply(cam);
+    return cam.render(world);
 }
 
-void checkered_spheres() {
+bool checkered_spheres() {
     hittable_list world;
 
     auto checker = make_shared<checker_texture>(0.32, color(0.2, 0.3, 0.1), color(0.9, 0.9, 0.9));
@@ -99,10 +179,11 @@ void checkered_spheres() {
 
     cam.defocus_angle = 0;
 
-    cam.render(world);
+    options.apply(cam);
+    return cam.render(world);
 }
 
-void earth() {
+bool earth() {
     auto earth_texture = make_shared<image_texture>("images/earthmap.jpg");
     auto earth_surface = make_shared<lambertian>(earth_texture);
     auto globe = make_shared<sphere>(point3(0,0,0), 2, earth_surface);
@@ -121,10 +202,11 @@ void earth() {
     cam.vup = vec3(0,1,0);
 
     cam.defocus_angle = 0;
-    cam.render(hittable_list(globe));
+    options.apply(cam);
+    return cam.render(hittable_list(globe));
 }
 
-void perlin_spheres() {
+bool perlin_spheres() {
     hittable_list world;
 
     auto pertext = make_shared<noise_texture>(4);
@@ -146,10 +228,11 @@ void perlin_spheres() {
 
     cam.defocus_angle = 0;
 
-    cam.render(world);
+    options.apply(cam);
+    return cam.render(world);
 }
 
-void quads() {
+bool quads() {
     hittable_list world;
 
     // Materials
@@ -181,10 +264,11 @@ void quads() {
 
     cam.defocus_angle = 0;
 
-    cam.render(world);
+    options.apply(cam);
+    return cam.render(world);
 }
 
-void simple_light() {
+bool simple_light() {
     hittable_list world;
 
     auto pertext = make_shared<noise_texture>(4);
@@ -210,10 +294,11 @@ void simple_light() {
 
     cam.defocus_angle = 0;
 
-    cam.render(world);
+    options.apply(cam);
+    return cam.render(world);
 }
 
-void cornell_box() {
+bool cornell_box() {
     hittable_list world;
 
     auto red = make_shared<lambertian>(color(.65, .05, .05));
@@ -229,13 +314,13 @@ void cornell_box() {
     world.add(make_shared<quad>(point3(0,0,555), vec3(555, 0, 0), vec3(0, 555, 0), white));
 
     shared_ptr<hittable> box1 = box(point3(0,0,0), point3(165, 330, 165), white);
-    box1 = make_shared<rotate_y>(box1, 15);
-    box1 = make_shared<translate>(box1, vec3(265, 0, 295));
+    box1 = make_shared<transform>(box1, affine::rotation(vec3(0, 1, 0), 15));
+    box1 = make_shared<transform>(box1, affine::translation(vec3(265, 0, 295)));
     world.add(box1);
 
     shared_ptr<hittable> box2 = box(point3(0,0,0), point3(165, 165, 165), white);
-    box2 = make_shared<rotate_y>(box2, -18);
-    box2 = make_shared<translate>(box2, vec3(130, 0, 65));
+    box2 = make_shared<transform>(box2, affine::rotation(vec3(0, 1, 0), -18));
+    box2 = make_shared<transform>(box2, affine::translation(vec3(130, 0, 65)));
     world.add(box2);
 
     camera cam;
@@ -253,10 +338,11 @@ void cornell_box() {
 
     cam.defocus_angle = 0;
 
-    cam.render(world);
+    options.apply(cam);
+    return cam.render(world);
 }
 
-void cornell_smoke() {
+bool cornell_smoke() {
     hittable_list world;
 
     auto red = make_shared<lambertian>(color(.65, .05, 0.05));
@@ -272,12 +358,12 @@ void cornell_smoke() {
     world.add(make_shared<quad>(point3(0, 0, 555), vec3(555, 0, 0), vec3(0, 555, 0), white));
 
     shared_ptr<hittable> box1 = box(point3(0,0,0), point3(165, 330, 165), white);
-    box1 = make_shared<rotate_y>(box1, 15);
-    box1 = make_shared<translate>(box1, vec3(265, 0, 295));
+    box1 = make_shared<transform>(box1, affine::rotation(vec3(0, 1, 0), 15));
+    box1 = make_shared<transform>(box1, affine::translation(vec3(265, 0, 295)));
 
     shared_ptr<hittable> box2 = box(point3(0,0,0), point3(165, 165, 165), white);
-    box2 = make_shared<rotate_y>(box2, -18);
-    box2 = make_shared<translate>(box2, vec3(130, 0, 65));
+    box2 = make_shared<transform>(box2, affine::rotation(vec3(0, 1, 0), -18));
+    box2 = make_shared<transform>(box2, affine::translation(vec3(130, 0, 65)));
 
     world.add(make_shared<constant_medium>(box1, 0.01, color(0,0,0)));
     world.add(make_shared<constant_medium>(box2, 0.01, color(1,1,1)));
@@ -297,11 +383,12 @@ void cornell_smoke() {
 
     cam.defocus_angle = 0;
 
-    cam.render(world);
+    options.apply(cam);
+    return cam.render(world);
 }
 
 
-void final_scene(int image_width, int samples_per_pixel, int max_depth) {
+bool final_scene(int image_width, int samples_per_pixel, int max_depth) {
     hittable_list boxes1;
     auto ground = make_shared<lambertian>(color(0.48, 0.83, 0.53));
 
@@ -322,7 +409,9 @@ void final_scene(int image_width, int samples_per_pixel, int max_depth) {
 
     hittable_list world;
 
-    world.add(make_shared<bvh_node>(boxes1));
+    bvh_build_options sah;
+    sah.method = bvh_split_method::sah;
+    world.add(make_shared<linear_bvh>(boxes1, sah));
 
     auto light = make_shared<diffuse_light>(color(7,7,7));
     world.add(make_shared<quad>(point3(123, 554, 147), vec3(300, 0, 0), vec3(0, 0, 265), light));
@@ -348,18 +437,16 @@ void final_scene(int image_width, int samples_per_pixel, int max_depth) {
     auto pertext = make_shared<noise_texture>(0.2);
     world.add(make_shared<sphere>(point3(220, 280, 300), 80, make_shared<lambertian>(pertext)));
 
-    hittable_list boxes2;
+    auto boxes2 = make_shared<sphere_set>();
     auto white = make_shared<lambertian>(color(0.73, 0.73, 0.73));
     int ns = 1000;
     for (int j = 0; j < ns; j++) {
-        boxes2.add(make_shared<sphere>(point3::random(0,165), 10, white));
+        boxes2->add(point3::random(0,165), 10, white);
     }
+    boxes2->build();
 
-    world.add(make_shared<translate>(
-        make_shared<rotate_y>(make_shared<bvh_node>(boxes2), 15),
-            vec3(-1000, 270, 395)
-        )
-    );
+    world.add(make_shared<transform>(boxes2,
+        affine::translation(vec3(-1000, 270, 395)) * affine::rotation(vec3(0, 1, 0), 15)));
 
     camera cam;
 
@@ -377,22 +464,241 @@ void final_scene(int image_width, int samples_per_pixel, int max_depth) {
 
     cam.defocus_angle = 0;
 
-    cam.render(world);
+    options.apply(cam);
+    return cam.render(world);
+}
+
+
+int render_scene_file(const std::string& path) {
+    scene_description scene;
+    if (!load_scene(path, scene, options.scene_cache))
+        return 1;
+
+    options.apply(scene.cam);
+    bool rendered = scene.lights.objects.empty() ? scene.cam.render(scene.world)
+                                                 : scene.cam.render(scene.world, scene.lights);
+    return rendered ? 0 : 1;
+}
+
+int render_scene(int scene) {
+    if (!scene_file.empty())
+        return render_scene_file(scene_file);
+
+    bool rendered;
+    switch (scene) {
+        case 1: rendered = bouncing_spheres();                                 break;
+        case 2: rendered = checkered_spheres();                                break;
+        case 3: rendered = earth();                                            break;
+        case 4: rendered = perlin_spheres();                                   break;
+        case 5: rendered = quads();                                            break;
+        case 6: rendered = simple_light();                                     break;
+        case 7: rendered = cornell_box();                                      break;
+        case 8: rendered = cornell_smoke();                                    break;
+        case 9: rendered = final_scene(800, 10000, 40); break;
+        default: rendered = final_scene(400, 250, 4);   break;
+    }
+    return rendered ? 0 : 1;
 }
 
+int render_with_local_workers(int scene) {
+    // Fork one worker per shard, then merge their partial buffers into the output image.
+    const int count = options.workers;
+    std::vector<std::string> shard_files;
+    for (int k = 0; k < count; k++)
+        shard_files.push_back(shard_file_name(options.output_file, k));
+
+    // Bring the scene cache up to date first, so the workers all map it instead of each
+    // parsing the scene and racing to write the cache.
+    if (!scene_file.empty() && !options.scene_cache.empty()) {
+        scene_description scene;
+        if (!load_scene(scene_file, scene, options.scene_cache))
+            return 1;
+    }
 
-int main() {
-    switch (7) {
-        case 1: bouncing_spheres();                                            break;
-        case 2: checkered_spheres();                                           break;
-        case 3: earth();                                                       break;
-        case 4: perlin_spheres();                                              break;
-        case 5: quads();                                                       break;
-        case 6: simple_light();                                                break;
-        case 7: cornell_box();                                                 break;
-        case 8: cornell_smoke();                                               break;
-        case 9: final_scene(800, 10000, 40); break;
-        default: final_scene(400, 250, 4);   break;
+    int failures = run_local_workers(count, [&](int k) {
+        options.shard_index = k;
+        options.shard_count = count;
+        options.shard_file = shard_files[k];
+        if (!options.checkpoint_file.empty())
+            options.checkpoint_file = shard_file_name(options.checkpoint_file, k);
+        return render_scene(scene);
+    });
+    if (failures > 0) {
+        std::cerr << "ERROR: " << failures << " of " << count << " workers failed.\n";
+        return 1;
     }
+
+    checkpoint_header header;
+    std::vector<pixel_stats> pixels;
+    if (!merge_shards(shard_files, header, pixels))
+        return 1;
+    if (!write_image(resolve_accumulation(header, pixels), options.output_file))
+        return 1;
+
+    for (const auto& path : shard_files)
+        std::remove(path.c_str());
+    return 0;
+}
+
+void usage(const char* program) {
+    std::cerr << "Usage: " << program << " [options] [SCENE_FILE]\n"
+              << "  SCENE_FILE            Scene description to render (see scenes/)\n"
+              << "  --scene N             Built-in scene to render (default 7, the Cornell box)\n"
+              << "  --output FILE         Image to write: .png, .pfm or .ppm (default image.png)\n"
+              << "  --scene-cache FILE    Cache SCENE_FILE in binary form, for faster reloads\n"
+              << "  --width N             Override the image width\n"
+              << "  --spp N               Override the samples per pixel\n"
+              << "  --depth N             Override the maximum ray depth\n"
+              << "  --seed N              Override the random seed\n"
+              << "  --packets             Trace camera rays in SIMD packets\n"
+              << "  --adaptive            Sample each pixel until its error is low enough\n"
+              << "  --adaptive-threshold X  Error at which --adaptive stops sampling a pixel\n"
+              << "  --max-spp N           Most samples per pixel --adaptive may take\n"
+              << "  --sample-counts FILE  Write an image of the samples taken per pixel\n"
+              << "  --pass-samples N      Render progressively in passes of N samples per pixel\n"
+              << "  --checkpoint FILE     Render progressively, saving its state to FILE\n"
+              << "  --resume              Continue from the --checkpoint file if it matches\n"
+              << "  --checkpoint-passes N Write a preview (and checkpoint) every N passes\n"
+              << "  --checkpoint-seconds S  Write a preview (and checkpoint) every S seconds\n"
+              << "  --time-budget S       Stop at the last pass that fits in S seconds\n"
+              << "  --workers N           Render in N local worker processes and merge\n"
+              << "  --shard I/N           Render only shard I of N to a partial buffer file\n"
+              << "  --shard-mode MODE     Split shards by 'regions' (default) or 'samples'\n"
+              << "  --shard-file FILE     Partial buffer to write (default OUTPUT.shardI)\n";
+}
+
+bool parse_positive(const char* text, int& value) {
+    // The whole of text must be a decimal integer from 1 to INT_MAX.
+    char* end;
+    errno = 0;
+    long n = std::strtol(text, &end, 10);
+    if (end == text || *end || errno == ERANGE || n < 1 || n > INT_MAX)
+        return false;
+    value = int(n);
+    return true;
 }
 
+bool parse_positive(const char* text, double& value) {
+    // The whole of text must be a finite number above zero.
+    char* end;
+    double x = std::strtod(text, &end);
+    if (end == text || *end || !std::isfinite(x) || x <= 0)
+        return false;
+    value = x;
+    return true;
+}
+
+bool parse_seed(const char* text, uint64_t& value) {
+    // Any 64-bit seed, exactly; strtoull alone would accept and negate a leading '-'.
+    char* end;
+    errno = 0;
+    unsigned long long n = std::strtoull(text, &end, 10);
+    if (!std::isdigit((unsigned char)text[0]) || *end || errno == ERANGE)
+        return false;
+    value = uint64_t(n);
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    int scene = 7;
+
+    for (int k = 1; k < argc; k++) {
+        const char* arg = argv[k];
+        const char* value = (k + 1 < argc) ? argv[k + 1] : nullptr;
+        auto takes_value = [&] {
+            if (!value) {
+                std::cerr << "ERROR: " << arg << " needs a value.\n";
+                std::exit(1);
+            }
+            k++;
+            return value;
+        };
+        auto takes_positive = [&](auto& number) {
+            if (!parse_positive(takes_value(), number)) {
+                const bool whole = std::is_same_v<std::decay_t<decltype(number)>, int>;
+                std::cerr << "ERROR: " << arg << " expects a positive "
+                          << (whole ? "whole number" : "number") << ", not '" << value << "'.\n";
+                std::exit(1);
+            }
+        };
+
+        if (!std::strcmp(arg, "--scene")) {
+            takes_positive(scene);
+        } else if (!std::strcmp(arg, "--output")) {
+            options.output_file = takes_value();
+        } else if (!std::strcmp(arg, "--scene-cache")) {
+            options.scene_cache = takes_value();
+        } else if (!std::strcmp(arg, "--width")) {
+            takes_positive(options.image_width);
+        } else if (!std::strcmp(arg, "--spp")) {
+            takes_positive(options.samples_per_pixel);
+        } else if (!std::strcmp(arg, "--depth")) {
+            takes_positive(options.max_depth);
+        } else if (!std::strcmp(arg, "--seed")) {
+            if (!parse_seed(takes_value(), options.seed)) {
+                std::cerr << "ERROR: --seed expects a whole number from 0 to 2^64-1, not '"
+                          << value << "'.\n";
+                return 1;
+            }
+            options.override_seed = true;
+        } else if (!std::strcmp(arg, "--packets")) {
+            options.ray_packets = true;
+        } else if (!std::strcmp(arg, "--adaptive")) {
+            options.adaptive_sampling = true;
+        } else if (!std::strcmp(arg, "--adaptive-threshold")) {
+            takes_positive(options.adaptive_threshold);
+        } else if (!std::strcmp(arg, "--max-spp")) {
+            takes_positive(options.max_samples_per_pixel);
+        } else if (!std::strcmp(arg, "--sample-counts")) {
+            options.sample_count_file = takes_value();
+        } else if (!std::strcmp(arg, "--pass-samples")) {
+            takes_positive(options.pass_samples);
+        } else if (!std::strcmp(arg, "--checkpoint")) {
+            options.checkpoint_file = takes_value();
+        } else if (!std::strcmp(arg, "--resume")) {
+            options.resume = true;
+        } else if (!std::strcmp(arg, "--checkpoint-passes")) {
+            takes_positive(options.checkpoint_passes);
+        } else if (!std::strcmp(arg, "--checkpoint-seconds")) {
+            takes_positive(options.checkpoint_seconds);
+        } else if (!std::strcmp(arg, "--time-budget")) {
+            takes_positive(options.time_budget_seconds);
+        } else if (!std::strcmp(arg, "--workers")) {
+            takes_positive(options.workers);
+        } else if (!std::strcmp(arg, "--shard")) {
+            if (std::sscanf(takes_value(), "%d/%d", &options.shard_index, &options.shard_count) != 2
+                || options.shard_count < 1 || options.shard_index < 0
+                || options.shard_index >= options.shard_count) {
+                std::cerr << "ERROR: --shard expects I/N with 0 <= I < N.\n";
+                return 1;
+            }
+        } else if (!std::strcmp(arg, "--shard-mode")) {
+            std::string mode = takes_value();
+            if (mode == "regions") {
+                options.shard_mode = shard_split::regions;
+            } else if (mode == "samples") {
+                options.shard_mode = shard_split::samples;
+            } else {
+                std::cerr << "ERROR: Unknown shard mode '" << mode << "'.\n";
+                return 1;
+            }
+        } else if (!std::strcmp(arg, "--shard-file")) {
+            options.shard_file = takes_value();
+        } else if (arg[0] != '-' && scene_file.empty()) {
+            scene_file = arg;
+        } else {
+            usage(argv[0]);
+            return (!std::strcmp(arg, "--help") || !std::strcmp(arg, "-h")) ? 0 : 1;
+        }
+    }
+
+    if (options.resume && options.checkpoint_file.empty()) {
+        std::cerr << "ERROR: --resume needs a --checkpoint file.\n";
+        return 1;
+    }
+
+    if (options.workers > 1)
+        return render_with_local_workers(scene);
+
+    return render_scene(scene);
+}
@@ -0,0 +1,72 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define RT_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+class mapped_file {
+  public:
+    // A whole file, read-only: mapped where mmap is available, otherwise read into memory.
+    mapped_file() = default;
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    ~mapped_file() {
+#ifdef RT_HAVE_MMAP
+        if (mapping)
+            ::munmap(mapping, length);
+#endif
+    }
+
+    bool open(const std::string& path) {
+#ifdef RT_HAVE_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        void* mapped = MAP_FAILED;
+        if (::fstat(fd, &st) == 0 && st.st_size > 0)
+            mapped = ::mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED)
+            return false;
+        mapping = mapped;
+        length = size_t(st.st_size);
+        bytes = static_cast<const char*>(mapped);
+        return true;
+#else
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+            return false;
+        buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        bytes = buffer.data();
+        length = buffer.size();
+        return true;
+#endif
+    }
+
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+  private:
+    const char* bytes = nullptr;
+    size_t length = 0;
+#ifdef RT_HAVE_MMAP
+    void* mapping = nullptr;
+#else
+    std::vector<char> buffer;
+#endif
+};
+
+#endif //MAPPED_FILE_H
@@ -13,9 +13,11 @@
 class scatter_record {
 public:
     color attenuation;
-    shared_ptr<pdf> pdf_ptr;
+    scatter_pdf pdf_storage;
     bool skip_pdf;
     ray skip_pdf_ray;
+
+    const pdf* pdf_ptr() const { return get_pdf(pdf_storage); }
 };
 
 class material {
@@ -53,7 +55,7 @@ public:
     bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec)
     const override {
         srec.attenuation = tex->value(rec.u, rec.v, rec.p);
-        srec.pdf_ptr = make_shared<cosine_pdf>(rec.normal);
+        srec.pdf_storage.emplace<cosine_pdf>(rec.normal);
         srec.skip_pdf = false;
         return true;
     }
@@ -78,9 +80,9 @@ public:
         reflected = unit_vector(reflected) + (fuzz * random_unit_vector());
 
         srec.attenuation = albedo;
-        srec.pdf_ptr = nullptr;
+        srec.pdf_storage = std::monostate{};
         srec.skip_pdf = true;
-        srec.skip_pdf_ray = ray(rec.p, reflected, r_in.time());
+        srec.skip_pdf_ray = ray(rec.spawn_origin(reflected), reflected, r_in.time());
         
         return true;
     }
@@ -96,7 +98,7 @@ public:
     bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec)
     const override {
         srec.attenuation = color(1.0, 1.0, 1.0);
-        srec.pdf_ptr = nullptr;
+        srec.pdf_storage = std::monostate{};
         srec.skip_pdf = true;
         double ri = rec.front_face ? (1.0/refraction_index) : refraction_index;
 
@@ -112,7 +114,7 @@ public:
         else
             direction = refract(unit_direction, rec.normal, ri);
 
-        srec.skip_pdf_ray = ray(rec.p, direction, r_in.time());
+        srec.skip_pdf_ray = ray(rec.spawn_origin(direction), direction, r_in.time());
         return true;
     }
 private:
@@ -152,7 +154,7 @@ public:
     bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec) 
     const override{
         srec.attenuation = tex->value(rec.u, rec.v, rec.p);
-        srec.pdf_ptr = make_shared<sphere_pdf>();
+        srec.pdf_storage.emplace<sphere_pdf>();
         srec.skip_pdf = false;
         
         return true;
@@ -0,0 +1,65 @@
+#include "rtweekend.h"
+
+#include "render_shard.h"
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Combines the partial buffers written by a sharded render (raytracer --shard I/N) into
+// the final image, e.g. after collecting them from the machines of a cluster.
+
+int main(int argc, char* argv[]) {
+    std::string counts_file;
+    std::vector<std::string> args;
+    for (int k = 1; k < argc; k++) {
+        if (!std::strcmp(argv[k], "--counts") && k + 1 < argc)
+            counts_file = argv[++k];
+        else
+            args.push_back(argv[k]);
+    }
+
+    if (args.size() < 2) {
+        std::cerr << "Usage: " << argv[0] << " [--counts MASK] OUTPUT SHARD...\n"
+                  << "  OUTPUT  Image to write: .png, .pfm or .ppm\n"
+                  << "  SHARD   Every partial buffer of the render, in any order\n"
+                  << "  MASK    Optional image of the samples taken per pixel\n";
+        return 1;
+    }
+
+    const std::string output = args[0];
+    const std::vector<std::string> shards(args.begin() + 1, args.end());
+
+    checkpoint_header header;
+    std::vector<pixel_stats> pixels;
+    if (!merge_shards(shards, header, pixels))
+        return 1;
+
+    if (!write_image(resolve_accumulation(header, pixels), output))
+        return 1;
+
+    long long total_samples = 0;
+    int max_samples = 1;
+    for (const auto& px : pixels) {
+        total_samples += px.count;
+        max_samples = std::max(max_samples, px.count);
+    }
+
+    if (!counts_file.empty()) {
+        framebuffer counts(int(header.width), int(header.height));
+        for (int j = 0; j < counts.height(); j++)
+            for (int i = 0; i < counts.width(); i++) {
+                double fraction = double(pixels[size_t(j) * counts.width() + i].count) / max_samples;
+                counts.set(i, j, color(fraction, fraction, fraction));
+            }
+        if (!write_image(counts, counts_file))
+            return 1;
+    }
+
+    std::clog << "Merged " << shards.size() << " shards into " << output << " ("
+              << header.width << "x" << header.height << ", "
+              << double(total_samples) / (double(header.width) * header.height)
+              << " samples per pixel)\n";
+    return 0;
+}
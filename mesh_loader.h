@@ -0,0 +1,738 @@
+#ifndef MESH_LOADER_H
+#define MESH_LOADER_H
+
+#include "mapped_file.h"
+#include "triangle_mesh.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Loads Wavefront OBJ and binary PLY files into triangle_mesh_data. Files are mapped and
+// parsed in place, without copying lines into strings. OBJ files are split into chunks at
+// line boundaries and parsed on all cores; their (position, uv, normal) index triples are
+// then de-duplicated into the shared vertices triangle_mesh expects. Polygons are split
+// into triangle fans.
+//
+// Worker threads are plain std::threads rather than OpenMP, so that a scene can be loaded
+// before run_local_workers forks.
+
+namespace mesh_loader_detail {
+
+template <typename Body>
+void parallel_for(size_t count, Body&& body) {
+    // Runs body(k) for every k in [0, count), spread over the hardware threads.
+    size_t threads = std::min<size_t>(count, std::max(1u, std::thread::hardware_concurrency()));
+    if (threads <= 1) {
+        for (size_t k = 0; k < count; k++)
+            body(k);
+        return;
+    }
+
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < threads; t++) {
+        pool.emplace_back([&, t] {
+            for (size_t k = t; k < count; k += threads)
+                body(k);
+        });
+    }
+    for (auto& thread : pool)
+        thread.join();
+}
+
+inline bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+inline void skip_spaces(const char*& p, const char* end) {
+    while (p < end && is_space(*p))
+        p++;
+}
+
+inline bool parse_int(const char*& p, const char* end, long long& value) {
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    if (p >= end || *p < '0' || *p > '9')
+        return false;
+    long long v = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+        v = v * 10 + (*p++ - '0');
+    value = negative ? -v : v;
+    return true;
+}
+
+inline bool parse_float(const char*& p, const char* end, float& value) {
+    // Decimal and scientific notation. The mantissa is accumulated in an integer, which
+    // is exact for the float precision vertex data is stored at.
+    skip_spaces(p, end);
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    int digits = 0;
+    bool any = false;
+    for (; p < end && *p >= '0' && *p <= '9'; p++, any = true) {
+        if (digits < 18) {
+            mantissa = mantissa * 10 + uint64_t(*p - '0');
+            if (mantissa) digits++;
+        } else {
+            exponent++;
+        }
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++, any = true) {
+            if (digits < 18) {
+                mantissa = mantissa * 10 + uint64_t(*p - '0');
+                if (mantissa) digits++;
+                exponent--;
+            }
+        }
+    }
+    if (!any) {
+        // inf and nan are not vertex data; treat them as errors.
+        return false;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        long long e;
+        if (parse_int(q, end, e)) {
+            exponent += int(std::clamp(e, -1000LL, 1000LL));
+            p = q;
+        }
+    }
+
+    double v = double(mantissa);
+    if (exponent != 0)
+        v *= std::pow(10.0, exponent);
+    value = float(negative ? -v : v);
+    return true;
+}
+
+inline const char* next_line(const char* p, const char* end) {
+    auto newline = static_cast<const char*>(std::memchr(p, '\n', size_t(end - p)));
+    return newline ? newline + 1 : end;
+}
+
+inline size_t line_number(const char* begin, const char* at) {
+    return size_t(std::count(begin, at, '\n')) + 1;
+}
+
+constexpr uint32_t missing = UINT32_MAX;
+
+struct obj_counts {
+    size_t positions = 0, uvs = 0, normals = 0;
+};
+
+struct obj_chunk {
+    const char* begin;
+    const char* end;
+    obj_counts counts;          // Attribute lines in this chunk
+    obj_counts first;           // Attribute lines in all earlier chunks
+    std::vector<float> positions, uvs, normals;
+    std::vector<uint32_t> corners;  // Position, uv, normal index per triangle corner
+    bool has_uvs = false, has_normals = false;
+    const char* error_at = nullptr;
+    const char* error = nullptr;
+};
+
+inline void count_obj_lines(obj_chunk& chunk) {
+    for (const char* p = chunk.begin; p < chunk.end; p = next_line(p, chunk.end)) {
+        skip_spaces(p, chunk.end);
+        if (chunk.end - p < 2 || p[0] != 'v')
+            continue;
+        if (is_space(p[1])) chunk.counts.positions++;
+        else if (p[1] == 't' && chunk.end - p > 2 && is_space(p[2])) chunk.counts.uvs++;
+        else if (p[1] == 'n' && chunk.end - p > 2 && is_space(p[2])) chunk.counts.normals++;
+    }
+}
+
+inline bool resolve_obj_index(long long index, size_t seen, size_t& out) {
+    // OBJ indices are 1-based, or negative to count back from the latest definition.
+    long long resolved = index > 0 ? index - 1 : (long long)seen + index;
+    if (index == 0 || resolved < 0 || resolved >= (long long)missing)
+        return false;
+    out = size_t(resolved);
+    return true;
+}
+
+inline void parse_obj_chunk(obj_chunk& chunk) {
+    chunk.positions.reserve(3 * chunk.counts.positions);
+    chunk.uvs.reserve(2 * chunk.counts.uvs);
+    chunk.normals.reserve(3 * chunk.counts.normals);
+
+    obj_counts seen = chunk.first;
+    uint32_t face[3 * 64];
+    const char* end = chunk.end;
+
+    auto fail = [&](const char* at, const char* message) {
+        chunk.error_at = at;
+        chunk.error = message;
+    };
+
+    for (const char* line = chunk.begin; line < end; line = next_line(line, end)) {
+        const char* p = line;
+        skip_spaces(p, end);
+        if (p >= end || (*p != 'v' && *p != 'f'))
+            continue;   // Comments, groups, materials and other statements are ignored
+
+        if (p[0] == 'v' && p + 1 < end && is_space(p[1])) {
+            p++;
+            float x, y, z;
+            if (!parse_float(p, end, x) || !parse_float(p, end, y) || !parse_float(p, end, z))
+                return fail(line, "bad vertex position");
+            chunk.positions.insert(chunk.positions.end(), { x, y, z });
+            seen.positions++;
+        } else if (p[0] == 'v' && p + 2 < end && p[1] == 't' && is_space(p[2])) {
+            p += 2;
+            float u, v = 0;
+            if (!parse_float(p, end, u))
+                return fail(line, "bad texture coordinate");
+            const char* q = p;
+            if (!parse_float(q, end, v)) v = 0; else p = q;
+            chunk.uvs.insert(chunk.uvs.end(), { u, v });
+            seen.uvs++;
+        } else if (p[0] == 'v' && p + 2 < end && p[1] == 'n' && is_space(p[2])) {
+            p += 2;
+            float x, y, z;
+            if (!parse_float(p, end, x) || !parse_float(p, end, y) || !parse_float(p, end, z))
+                return fail(line, "bad vertex normal");
+            chunk.normals.insert(chunk.normals.end(), { x, y, z });
+            seen.normals++;
+        } else if (p[0] == 'f' && p + 1 < end && is_space(p[1])) {
+            // Corners are v, v/vt, v//vn or v/vt/vn.
+            p++;
+            int corner_count = 0;
+            while (true) {
+                skip_spaces(p, end);
+                if (p >= end || *p == '\n' || *p == '#')
+                    break;
+                long long index;
+                size_t v, vt = missing, vn = missing;
+                if (!parse_int(p, end, index) || !resolve_obj_index(index, seen.positions, v))
+                    return fail(line, "bad face vertex index");
+                if (p < end && *p == '/') {
+                    p++;
+                    if (p < end && *p != '/') {
+                        if (!parse_int(p, end, index) || !resolve_obj_index(index, seen.uvs, vt))
+                            return fail(line, "bad face texture coordinate index");
+                        chunk.has_uvs = true;
+                    }
+                    if (p < end && *p == '/') {
+                        p++;
+                        if (!parse_int(p, end, index) || !resolve_obj_index(index, seen.normals, vn))
+                            return fail(line, "bad face normal index");
+                        chunk.has_normals = true;
+                    }
+                }
+                if (corner_count == 64)
+                    return fail(line, "face has more than 64 corners");
+                face[3*corner_count + 0] = uint32_t(v);
+                face[3*corner_count + 1] = uint32_t(vt);
+                face[3*corner_count + 2] = uint32_t(vn);
+                corner_count++;
+            }
+            if (corner_count < 3)
+                return fail(line, "face has fewer than three corners");
+
+            for (int k = 1; k + 1 < corner_count; k++) {
+                chunk.corners.insert(chunk.corners.end(), face, face + 3);
+                chunk.corners.insert(chunk.corners.end(), face + 3*k, face + 3*k + 6);
+            }
+        }
+    }
+}
+
+class vertex_table {
+  public:
+    // Open-addressing map from an OBJ (position, uv, normal) index triple to the index of
+    // the shared vertex made for it.
+    explicit vertex_table(size_t expected) {
+        size_t capacity = 16;
+        while (capacity < 2 * expected)
+            capacity *= 2;
+        slots.assign(capacity, slot{ { missing, missing, missing }, missing });
+    }
+
+    // Returns the vertex for key, or missing after inserting value as the new vertex.
+    uint32_t find_or_insert(const uint32_t key[3], uint32_t value) {
+        if (2 * (count + 1) > slots.size())
+            grow();
+        size_t mask = slots.size() - 1;
+        for (size_t i = hash(key) & mask; ; i = (i + 1) & mask) {
+            auto& s = slots[i];
+            if (s.value == missing) {
+                std::memcpy(s.key, key, sizeof(s.key));
+                s.value = value;
+                count++;
+                return missing;
+            }
+            if (s.key[0] == key[0] && s.key[1] == key[1] && s.key[2] == key[2])
+                return s.value;
+        }
+    }
+
+  private:
+    struct slot {
+        uint32_t key[3];
+        uint32_t value;
+    };
+
+    std::vector<slot> slots;
+    size_t count = 0;
+
+    static size_t hash(const uint32_t key[3]) {
+        uint64_t h = key[0] * 0x9e3779b97f4a7c15ULL;
+        h ^= (key[1] + 0x632be59bd9b4e019ULL) * 0xc2b2ae3d27d4eb4fULL;
+        h ^= (key[2] + 0x165667b19e3779f9ULL) * 0x27d4eb2f165667c5ULL;
+        return size_t(h ^ (h >> 29));
+    }
+
+    void grow() {
+        std::vector<slot> old;
+        old.swap(slots);
+        slots.assign(2 * old.size(), slot{ { missing, missing, missing }, missing });
+        count = 0;
+        for (const auto& s : old)
+            if (s.value != missing)
+                find_or_insert(s.key, s.value);
+    }
+};
+
+inline bool load_obj(const mapped_file& file, const std::string& path, triangle_mesh_data& mesh) {
+    const char* begin = file.data();
+    const char* end = begin + file.size();
+
+    // Chunks of about 4 MB, each starting at the beginning of a line.
+    const size_t chunk_bytes = size_t(4) << 20;
+    std::vector<obj_chunk> chunks;
+    for (const char* p = begin; p < end; ) {
+        const char* chunk_end = (size_t(end - p) > chunk_bytes) ? next_line(p + chunk_bytes, end) : end;
+        obj_chunk chunk;
+        chunk.begin = p;
+        chunk.end = chunk_end;
+        chunks.push_back(std::move(chunk));
+        p = chunk_end;
+    }
+
+    // Counting attribute lines first tells each chunk how many came before it, which
+    // resolves negative (relative) indices and places each chunk's vertices.
+    parallel_for(chunks.size(), [&](size_t k) { count_obj_lines(chunks[k]); });
+    obj_counts total;
+    for (auto& chunk : chunks) {
+        chunk.first = total;
+        total.positions += chunk.counts.positions;
+        total.uvs += chunk.counts.uvs;
+        total.normals += chunk.counts.normals;
+    }
+
+    parallel_for(chunks.size(), [&](size_t k) { parse_obj_chunk(chunks[k]); });
+
+    bool has_uvs = false, has_normals = false;
+    size_t corner_count = 0;
+    for (const auto& chunk : chunks) {
+        if (chunk.error) {
+            std::cerr << "ERROR: " << path << ":" << line_number(begin, chunk.error_at) << ": "
+                      << chunk.error << ".\n";
+            return false;
+        }
+        has_uvs |= chunk.has_uvs;
+        has_normals |= chunk.has_normals;
+        corner_count += chunk.corners.size() / 3;
+    }
+
+    std::vector<float> positions, uvs, normals;
+    positions.reserve(3 * total.positions);
+    uvs.reserve(2 * total.uvs);
+    normals.reserve(3 * total.normals);
+    for (auto& chunk : chunks) {
+        positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+        uvs.insert(uvs.end(), chunk.uvs.begin(), chunk.uvs.end());
+        normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+        std::vector<float>().swap(chunk.positions);
+        std::vector<float>().swap(chunk.uvs);
+        std::vector<float>().swap(chunk.normals);
+    }
+
+    mesh = triangle_mesh_data();
+    mesh.indices.reserve(corner_count);
+
+    if (!has_uvs && !has_normals) {
+        // Corners name positions only, so the positions are already the shared vertices.
+        for (const auto& chunk : chunks)
+            for (size_t k = 0; k < chunk.corners.size(); k += 3)
+                mesh.indices.push_back(chunk.corners[k]);
+        mesh.positions.swap(positions);
+    } else {
+        // One vertex per distinct (position, uv, normal) triple.
+        vertex_table table(std::max(total.positions, std::max(total.uvs, total.normals)));
+        mesh.positions.reserve(3 * total.positions);
+        for (const auto& chunk : chunks) {
+            for (size_t k = 0; k < chunk.corners.size(); k += 3) {
+                const uint32_t* corner = &chunk.corners[k];
+                auto next = uint32_t(mesh.vertex_count());
+                auto existing = table.find_or_insert(corner, next);
+                if (existing != missing) {
+                    mesh.indices.push_back(existing);
+                    continue;
+                }
+
+                if (corner[0] >= total.positions || (corner[1] != missing && corner[1] >= total.uvs)
+                    || (corner[2] != missing && corner[2] >= total.normals)) {
+                    std::cerr << "ERROR: " << path << ": face refers to an undefined vertex.\n";
+                    return false;
+                }
+
+                mesh.positions.insert(mesh.positions.end(), &positions[3 * size_t(corner[0])],
+                                      &positions[3 * size_t(corner[0])] + 3);
+                if (has_uvs) {
+                    const float none[2] = { 0, 0 };
+                    const float* uv = corner[1] != missing ? &uvs[2 * size_t(corner[1])] : none;
+                    mesh.uvs.insert(mesh.uvs.end(), uv, uv + 2);
+                }
+                if (has_normals) {
+                    const float none[3] = { 0, 0, 0 };
+                    const float* n = corner[2] != missing ? &normals[3 * size_t(corner[2])] : none;
+                    mesh.normals.insert(mesh.normals.end(), n, n + 3);
+                }
+                mesh.indices.push_back(next);
+            }
+        }
+    }
+
+    for (auto index : mesh.indices) {
+        if (index >= mesh.vertex_count()) {
+            std::cerr << "ERROR: " << path << ": face refers to an undefined vertex.\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Binary PLY
+
+enum class ply_type { int8, uint8, int16, uint16, int32, uint32, float32, float64, invalid };
+
+inline ply_type parse_ply_type(const std::string& name) {
+    if (name == "char" || name == "int8")     return ply_type::int8;
+    if (name == "uchar" || name == "uint8")   return ply_type::uint8;
+    if (name == "short" || name == "int16")   return ply_type::int16;
+    if (name == "ushort" || name == "uint16") return ply_type::uint16;
+    if (name == "int" || name == "int32")     return ply_type::int32;
+    if (name == "uint" || name == "uint32")   return ply_type::uint32;
+    if (name == "float" || name == "float32") return ply_type::float32;
+    if (name == "double" || name == "float64") return ply_type::float64;
+    return ply_type::invalid;
+}
+
+inline size_t ply_type_size(ply_type type) {
+    switch (type) {
+        case ply_type::int8: case ply_type::uint8:    return 1;
+        case ply_type::int16: case ply_type::uint16:  return 2;
+        case ply_type::int32: case ply_type::uint32: case ply_type::float32: return 4;
+        case ply_type::float64:                       return 8;
+        default:                                      return 0;
+    }
+}
+
+inline bool ply_type_is_integer(ply_type type) {
+    return type != ply_type::float32 && type != ply_type::float64 && type != ply_type::invalid;
+}
+
+inline double read_ply_value(const char* p, ply_type type, bool big_endian) {
+    unsigned char bytes[8];
+    size_t size = ply_type_size(type);
+    std::memcpy(bytes, p, size);
+    if (big_endian)
+        std::reverse(bytes, bytes + size);
+
+    switch (type) {
+        case ply_type::int8:    { int8_t v;   std::memcpy(&v, bytes, 1); return v; }
+        case ply_type::uint8:   { uint8_t v;  std::memcpy(&v, bytes, 1); return v; }
+        case ply_type::int16:   { int16_t v;  std::memcpy(&v, bytes, 2); return v; }
+        case ply_type::uint16:  { uint16_t v; std::memcpy(&v, bytes, 2); return v; }
+        case ply_type::int32:   { int32_t v;  std::memcpy(&v, bytes, 4); return v; }
+        case ply_type::uint32:  { uint32_t v; std::memcpy(&v, bytes, 4); return v; }
+        case ply_type::float32: { float v;    std::memcpy(&v, bytes, 4); return v; }
+        case ply_type::float64: { double v;   std::memcpy(&v, bytes, 8); return v; }
+        default:                return 0;
+    }
+}
+
+struct ply_property {
+    std::string name;
+    ply_type type = ply_type::invalid;
+    bool is_list = false;
+    ply_type count_type = ply_type::invalid;
+};
+
+struct ply_element {
+    std::string name;
+    size_t count = 0;
+    std::vector<ply_property> properties;
+
+    bool fixed_size() const {
+        return std::none_of(properties.begin(), properties.end(),
+                            [](const ply_property& p) { return p.is_list; });
+    }
+
+    size_t stride() const {
+        size_t size = 0;
+        for (const auto& p : properties)
+            size += ply_type_size(p.type);
+        return size;
+    }
+
+    size_t min_stride() const {
+        // Bytes in the shortest possible record: every list empty.
+        size_t size = 0;
+        for (const auto& p : properties)
+            size += ply_type_size(p.is_list ? p.count_type : p.type);
+        return size;
+    }
+
+    int find(std::initializer_list<const char*> names) const {
+        for (size_t k = 0; k < properties.size(); k++)
+            for (auto name : names)
+                if (properties[k].name == name && !properties[k].is_list)
+                    return int(k);
+        return -1;
+    }
+};
+
+inline bool load_ply(const mapped_file& file, const std::string& path, triangle_mesh_data& mesh) {
+    const char* begin = file.data();
+    const char* end = begin + file.size();
+
+    auto fail = [&](const std::string& message) {
+        std::cerr << "ERROR: " << path << ": " << message << ".\n";
+        return false;
+    };
+
+    // The header is short text: read it word by word.
+    bool big_endian = false;
+    std::vector<ply_element> elements;
+    const char* p = begin;
+    auto word = [&] {
+        skip_spaces(p, end);
+        const char* start = p;
+        while (p < end && !is_space(*p) && *p != '\n')
+            p++;
+        return std::string(start, p);
+    };
+
+    if (word() != "ply")
+        return fail("not a PLY file");
+    for (p = next_line(p, end); ; p = next_line(p, end)) {
+        if (p >= end)
+            return fail("header has no end_header");
+        auto keyword = word();
+        if (keyword == "end_header") {
+            p = next_line(p, end);
+            break;
+        } else if (keyword == "format") {
+            auto format = word();
+            if (format == "binary_big_endian")
+                big_endian = true;
+            else if (format != "binary_little_endian")
+                return fail("only binary PLY files are supported, not '" + format + "'");
+        } else if (keyword == "element") {
+            ply_element element;
+            element.name = word();
+            element.count = size_t(std::strtoull(word().c_str(), nullptr, 10));
+            elements.push_back(element);
+        } else if (keyword == "property") {
+            if (elements.empty())
+                return fail("property before any element");
+            ply_property property;
+            auto type = word();
+            if (type == "list") {
+                property.is_list = true;
+                property.count_type = parse_ply_type(word());
+                type = word();
+            }
+            property.type = parse_ply_type(type);
+            property.name = word();
+            if (property.type == ply_type::invalid
+                || (property.is_list && property.count_type == ply_type::invalid))
+                return fail("unknown property type in '" + property.name + "'");
+            elements.back().properties.push_back(property);
+        }
+    }
+
+    mesh = triangle_mesh_data();
+    for (const auto& element : elements) {
+        if (element.name == "vertex") {
+            if (!element.fixed_size())
+                return fail("vertex element has list properties");
+            const size_t stride = element.stride();
+            if (size_t(end - p) / std::max<size_t>(stride, 1) < element.count)
+                return fail("file ends inside the vertex data");
+
+            int x = element.find({ "x" }), y = element.find({ "y" }), z = element.find({ "z" });
+            int nx = element.find({ "nx" }), ny = element.find({ "ny" }), nz = element.find({ "nz" });
+            int u = element.find({ "u", "s", "texture_u", "texture_s" });
+            int v = element.find({ "v", "t", "texture_v", "texture_t" });
+            if (x < 0 || y < 0 || z < 0)
+                return fail("vertex element has no x, y and z");
+            bool has_normals = nx >= 0 && ny >= 0 && nz >= 0;
+            bool has_uvs = u >= 0 && v >= 0;
+
+            std::vector<size_t> offsets;
+            size_t offset = 0;
+            for (const auto& property : element.properties) {
+                offsets.push_back(offset);
+                offset += ply_type_size(property.type);
+            }
+
+            mesh.positions.resize(3 * element.count);
+            if (has_normals) mesh.normals.resize(3 * element.count);
+            if (has_uvs) mesh.uvs.resize(2 * element.count);
+
+            // Fixed-size records: split the vertices into blocks and convert in parallel.
+            const char* data = p;
+            auto read = [&](const char* record, int property) {
+                return float(read_ply_value(record + offsets[property],
+                                            element.properties[property].type, big_endian));
+            };
+            const size_t block = 1 << 16;
+            parallel_for((element.count + block - 1) / block, [&](size_t b) {
+                size_t last = std::min(element.count, (b + 1) * block);
+                for (size_t k = b * block; k < last; k++) {
+                    const char* record = data + k * stride;
+                    mesh.positions[3*k + 0] = read(record, x);
+                    mesh.positions[3*k + 1] = read(record, y);
+                    mesh.positions[3*k + 2] = read(record, z);
+                    if (has_normals) {
+                        mesh.normals[3*k + 0] = read(record, nx);
+                        mesh.normals[3*k + 1] = read(record, ny);
+                        mesh.normals[3*k + 2] = read(record, nz);
+                    }
+                    if (has_uvs) {
+                        mesh.uvs[2*k + 0] = read(record, u);
+                        mesh.uvs[2*k + 1] = read(record, v);
+                    }
+                }
+            });
+            p += element.count * stride;
+        } else {
+            // Faces (and any other element, which is skipped) are read record by record,
+            // since list properties make their records vary in size.
+            const bool faces = element.name == "face";
+            const size_t min_stride = element.min_stride();
+            if (min_stride == 0)
+                continue;   // Nothing to read, however many records the header claims
+            if (size_t(end - p) / min_stride < element.count)
+                return fail("file ends inside the " + element.name + " data");
+            int indices = -1;
+            if (faces) {
+                for (size_t k = 0; k < element.properties.size(); k++) {
+                    const auto& name = element.properties[k].name;
+                    if (element.properties[k].is_list
+                        && (name == "vertex_indices" || name == "vertex_index"))
+                        indices = int(k);
+                }
+                if (indices < 0)
+                    return fail("face element has no vertex_indices list");
+                if (!ply_type_is_integer(element.properties[indices].type))
+                    return fail("face vertex indices are not integers");
+                mesh.indices.reserve(3 * element.count);
+            }
+
+            for (size_t k = 0; k < element.count; k++) {
+                for (size_t prop = 0; prop < element.properties.size(); prop++) {
+                    const auto& property = element.properties[prop];
+                    if (!property.is_list) {
+                        if (size_t(end - p) < ply_type_size(property.type))
+                            return fail("file ends inside the " + element.name + " data");
+                        p += ply_type_size(property.type);
+                        continue;
+                    }
+
+                    const size_t count_size = ply_type_size(property.count_type);
+                    if (size_t(end - p) < count_size)
+                        return fail("file ends inside the " + element.name + " data");
+                    if (!ply_type_is_integer(property.count_type))
+                        return fail("list length in '" + property.name + "' is not an integer");
+                    auto signed_count = int64_t(read_ply_value(p, property.count_type, big_endian));
+                    if (signed_count < 0)
+                        return fail("negative list length in '" + property.name + "'");
+                    auto count = size_t(signed_count);
+                    p += count_size;
+                    const size_t item_size = ply_type_size(property.type);
+                    if (size_t(end - p) / item_size < count)
+                        return fail("file ends inside the " + element.name + " data");
+
+                    if (faces && int(prop) == indices && count >= 3) {
+                        // Indices are integers of at most 32 bits, so a double holds them
+                        // exactly; negative ones are rejected before converting to uint32_t.
+                        bool negative = false;
+                        auto corner = [&](size_t c) {
+                            auto index = int64_t(read_ply_value(p + c * item_size, property.type,
+                                                                big_endian));
+                            negative |= index < 0;
+                            return uint32_t(std::max<int64_t>(index, 0));
+                        };
+                        auto first = corner(0);
+                        for (size_t c = 1; c + 1 < count; c++)
+                            mesh.add_triangle(first, corner(c), corner(c + 1));
+                        if (negative)
+                            return fail("face refers to a negative vertex index");
+                    }
+                    p += count * item_size;
+                }
+            }
+        }
+    }
+
+    for (auto index : mesh.indices)
+        if (index >= mesh.vertex_count())
+            return fail("face refers to an undefined vertex");
+    return true;
+}
+
+} // namespace mesh_loader_detail
+
+inline bool load_mesh(const std::string& path, triangle_mesh_data& mesh) {
+    // Chooses the format by extension: .obj or .ply.
+    auto start = std::chrono::steady_clock::now();
+
+    mapped_file file;
+    if (!file.open(path)) {
+        std::cerr << "ERROR: Could not open mesh file '" << path << "'.\n";
+        return false;
+    }
+
+    auto dot = path.find_last_of('.');
+    std::string extension = (dot == std::string::npos) ? "" : path.substr(dot);
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return char(std::tolower(c)); });
+
+    bool loaded;
+    if (extension == ".obj") {
+        loaded = mesh_loader_detail::load_obj(file, path, mesh);
+    } else if (extension == ".ply") {
+        loaded = mesh_loader_detail::load_ply(file, path, mesh);
+    } else {
+        std::cerr << "ERROR: Unknown mesh format '" << extension << "' (expected .obj or .ply).\n";
+        return false;
+    }
+    if (!loaded)
+        return false;
+
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    auto megabytes = file.size() / 1e6;
+    std::clog << "Loaded " << path << ": " << mesh.triangle_count() << " triangles, "
+              << mesh.vertex_count() << " vertices, " << megabytes << " MB in " << seconds
+              << " s (" << megabytes / seconds << " MB/s)\n";
+    return true;
+}
+
+#endif //MESH_LOADER_H
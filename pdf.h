@@ -5,6 +5,9 @@
 #include "onb.h"
 #include "hittable_list.h"
 
+#include <type_traits>
+#include <variant>
+
 class pdf {
 public:
     virtual ~pdf() {}
@@ -60,9 +63,10 @@ private:
 
 class mixture_pdf : public pdf {
 public:
-    mixture_pdf(shared_ptr<pdf> p0, shared_ptr<pdf> p1) {
-        p[0] = p0;
-        p[1] = p1;
+    // Non-owning: the two PDFs usually live on the caller's stack for a single bounce.
+    mixture_pdf(const pdf& p0, const pdf& p1) {
+        p[0] = &p0;
+        p[1] = &p1;
     }
 
     double value(const vec3& direction) const override {
@@ -76,6 +80,19 @@ public:
             return p[1]->generate();
     }
 private:
-    shared_ptr<pdf> p[2]; 
+    const pdf* p[2];
 };
+
+// In-place storage for the PDF a material hands back from scatter(), so that sampling a
+// bounce never touches the heap. monostate means the material did not provide one.
+using scatter_pdf = std::variant<std::monostate, cosine_pdf, sphere_pdf>;
+
+inline const pdf* get_pdf(const scatter_pdf& storage) {
+    return std::visit([](const auto& p) -> const pdf* {
+        if constexpr (std::is_base_of_v<pdf, std::decay_t<decltype(p)>>)
+            return &p;
+        else
+            return nullptr;
+    }, storage);
+}
 #endif
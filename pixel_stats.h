@@ -0,0 +1,71 @@
+#ifndef PIXEL_STATS_H
+#define PIXEL_STATS_H
+
+#include "color.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Running totals for one pixel: the sum of its samples, for the final average, and
+// Welford's running mean and squared deviation of sample luminance, from which adaptive
+// sampling estimates how far the average still is from converging.
+
+inline double luminance(const color& c) {
+    return 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
+}
+
+class pixel_stats {
+  public:
+    color sum;
+    int count = 0;
+
+    void add(const color& sample) {
+        sum += sample;
+        count++;
+
+        // NaN samples are written out as black, so count them as zero here as well.
+        auto y = luminance(sample);
+        if (y != y) y = 0;
+        auto delta = y - mean;
+        mean += delta / count;
+        m2 += delta * (y - mean);
+    }
+
+    void merge(const pixel_stats& other) {
+        // Combine two independent sets of samples of the same pixel (Chan et al.'s
+        // pairwise update for the running variance).
+        if (other.count == 0)
+            return;
+        if (count == 0) {
+            *this = other;
+            return;
+        }
+
+        int n = count + other.count;
+        auto delta = other.mean - mean;
+        sum += other.sum;
+        mean += delta * other.count / n;
+        m2 += other.m2 + delta * delta * (double(count) * other.count / n);
+        count = n;
+    }
+
+    color average() const { return count > 0 ? sum * (1.0 / count) : color(0, 0, 0); }
+
+    double variance() const { return count > 1 ? m2 / (count - 1) : 0; }
+
+    double display_error() const {
+        // Standard error of the mean luminance, carried through the gamma 2 transform the
+        // image writers apply (d sqrt(y) = dy / (2 sqrt(y))), so that it measures the noise
+        // visible in the written image. The small floor keeps near-black pixels from
+        // demanding unbounded accuracy.
+        if (count < 2)
+            return infinity;
+        return std::sqrt(variance() / count) / (2 * std::sqrt(std::max(mean, 0.0) + 0.001));
+    }
+
+  private:
+    double mean = 0;
+    double m2 = 0;
+};
+
+#endif //PIXEL_STATS_H
@@ -31,34 +31,99 @@ public:
     aabb bounding_box() const override { return bbox; }
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-        auto denom = dot(normal, r.direction());
-
-        // No hit if the ray is parallel to the plane.
-        if (std::fabs(denom) < 1e-8)
+        real t, alpha, beta;
+        if (!hit_plane(Q, u, v, w, normal, D, r, ray_t, t, alpha, beta))
             return false;
 
-        // Return false if the hit point parameter t is outside the ray interval
-        auto t = (D - dot(normal, r.origin())) / denom;
-        if (!ray_t.contains(t))
+        if (!is_interior(alpha, beta, rec))
             return false;
 
-        auto intersection = r.at(t);
-        vec3 planar_hitpt_vector = intersection - Q;
-        auto alpha = dot(w, cross(planar_hitpt_vector, v));
-        auto beta = dot(w, cross(u, planar_hitpt_vector));
+        // Ray hits the 2D shape; set the rest of the hit record and return true;
 
-        if (!is_interior(alpha, beta, rec))
+        rec.t = t;
+        set_hit_point(Q, u, v, normal, alpha, beta, rec);
+        rec.mat = mat.get();
+        rec.set_face_normal(r, normal);
+
+        return true;
+
+    }
+
+    static bool hit_quad(const point3& Q, const vec3& u, const vec3& v, const vec3& w,
+                         const vec3& normal, real D, const material* mat, const ray& r,
+                         interval ray_t, hit_record& rec) {
+        // hit() for a plain parallelogram given by value, for callers that store quads as
+        // plain data (see cached_scene). w, normal and D are derived as the constructor does.
+        real t, alpha, beta;
+        if (!hit_plane(Q, u, v, w, normal, D, r, ray_t, t, alpha, beta))
             return false;
 
-        // Ray hits the 2D shape; set the rest of the hit record and return true;
+        interval unit_interval = interval(0, 1);
+        if (!unit_interval.contains(alpha) || !unit_interval.contains(beta))
+            return false;
 
+        rec.u = alpha;
+        rec.v = beta;
         rec.t = t;
-        rec.p = intersection;
+        set_hit_point(Q, u, v, normal, alpha, beta, rec);
         rec.mat = mat;
         rec.set_face_normal(r, normal);
 
         return true;
+    }
 
+    ray_packet::lane_mask hit_packet(ray_packet& rays, ray_packet::lane_mask active,
+                                     hit_record* recs) const override {
+        // Plane intersection and planar coordinates for every lane at once; the interior
+        // test stays per lane since subclasses override is_interior().
+        constexpr int n = ray_packet::size;
+        alignas(64) double t_hit[n], alpha[n], beta[n];
+        alignas(64) bool candidate[n];
+
+        #pragma omp simd
+        for (int lane = 0; lane < n; lane++) {
+            auto denom = normal.x()*rays.dx[lane] + normal.y()*rays.dy[lane]
+                       + normal.z()*rays.dz[lane];
+            auto t = (D - (normal.x()*rays.ox[lane] + normal.y()*rays.oy[lane]
+                         + normal.z()*rays.oz[lane])) / denom;
+
+            // Planar hit point vector relative to Q.
+            auto px = rays.ox[lane] + t*rays.dx[lane] - Q.x();
+            auto py = rays.oy[lane] + t*rays.dy[lane] - Q.y();
+            auto pz = rays.oz[lane] + t*rays.dz[lane] - Q.z();
+
+            // alpha = dot(w, cross(p, v)), beta = dot(w, cross(u, p))
+            alpha[lane] = w.x()*(py*v.z() - pz*v.y()) + w.y()*(pz*v.x() - px*v.z())
+                        + w.z()*(px*v.y() - py*v.x());
+            beta[lane] = w.x()*(u.y()*pz - u.z()*py) + w.y()*(u.z()*px - u.x()*pz)
+                       + w.z()*(u.x()*py - u.y()*px);
+
+            t_hit[lane] = t;
+            auto length_squared = rays.dx[lane]*rays.dx[lane] + rays.dy[lane]*rays.dy[lane]
+                                + rays.dz[lane]*rays.dz[lane];
+            candidate[lane] = denom*denom >= 1e-16 * length_squared
+                           && rays.t_min[lane] <= t && t <= rays.t_max[lane];
+        }
+
+        ray_packet::lane_mask hits = 0;
+        for (int lane = 0; lane < n; lane++) {
+            if (!ray_packet::has_lane(active, lane) || !candidate[lane])
+                continue;
+
+            auto& rec = recs[lane];
+            if (!is_interior(alpha[lane], beta[lane], rec))
+                continue;
+
+            auto r = rays.get(lane);
+            rec.t = t_hit[lane];
+            set_hit_point(Q, u, v, normal, alpha[lane], beta[lane], rec);
+            rec.mat = mat.get();
+            rec.set_face_normal(r, normal);
+
+            rays.t_max[lane] = rec.t;
+            hits |= ray_packet::lane_mask(1) << lane;
+        }
+        return hits;
     }
 
     virtual bool is_interior(double a, double b, hit_record& rec) const {
@@ -77,7 +142,7 @@ public:
 
     double pdf_value(const point3& origin, const vec3& direction) const override {
         hit_record rec;
-        if (!this->hit(ray(origin, direction), interval(0.001, infinity), rec))
+        if (!this->hit(ray(origin, direction), interval(0, infinity), rec))
             return 0;
 
         auto distance_squared = rec.t * rec.t * direction.length_squared();
@@ -92,19 +157,53 @@ public:
     }
 
 private:
+    static void set_hit_point(const point3& Q, const vec3& u, const vec3& v, const vec3& normal,
+                              real alpha, real beta, hit_record& rec) {
+        // The hit point from its planar coordinates rather than from the ray: it is then
+        // within a few roundings of the plane whatever error alpha and beta carry.
+        auto along_u = alpha * u;
+        auto along_v = beta * v;
+        rec.p = Q + along_u + along_v;
+        rec.set_error_bound(normal,
+                            rounding_gamma<real>(6) * (abs(Q) + abs(along_u) + abs(along_v)));
+    }
+
+    static bool hit_plane(const point3& Q, const vec3& u, const vec3& v, const vec3& w,
+                          const vec3& normal, real D, const ray& r, const interval& ray_t,
+                          real& t, real& alpha, real& beta) {
+        // Intersects the quad's plane and returns the hit's planar coordinates.
+        auto denom = dot(normal, r.direction());
+
+        // No hit if the ray is parallel to the plane, relative to the direction's length:
+        // a transform may have scaled it far from unit length.
+        if (denom*denom < 1e-16 * r.direction().length_squared())
+            return false;
+
+        // Return false if the hit point parameter t is outside the ray interval
+        t = (D - dot(normal, r.origin())) / denom;
+        if (!ray_t.contains(t))
+            return false;
+
+        auto intersection = r.at(t);
+        vec3 planar_hitpt_vector = intersection - Q;
+        alpha = dot(w, cross(planar_hitpt_vector, v));
+        beta = dot(w, cross(u, planar_hitpt_vector));
+        return true;
+    }
+
     point3 Q;
     vec3 u, v;
     vec3 w;
     shared_ptr<material> mat;
     aabb bbox;
     vec3 normal;
-    double D;
+    real D;
     double area;
 };
 
-inline shared_ptr<hittable_list> box(const point3& a, const point3& b, shared_ptr<material> mat) {
-    // Returns the 3D box (six sides) that contains the two opposite vertices a & b.
-    auto sides = make_shared<hittable_list>();
+template <typename AddSide>
+inline void box_sides(const point3& a, const point3& b, AddSide&& add_side) {
+    // Calls add_side(Q, u, v) for each of the six sides of the box with opposite vertices a & b.
 
     // Construct the two opposite vertices with the minimum and maximum coordinates.
     auto min = point3(std::fmin(a.x(), b.x()), std::fmin(a.y(), b.y()), std::fmin(a.z(), b.z()));
@@ -114,12 +213,21 @@ inline shared_ptr<hittable_list> box(const point3& a, const point3& b, shared_pt
     auto dy = vec3(0, max.y() - min.y(), 0);
     auto dz = vec3(0, 0, max.z() - min.z());
 
-    sides->add(make_shared<quad>(point3(min.x(), min.y(), max.z()), dx, dy, mat)); // front
-    sides->add(make_shared<quad>(point3(max.x(), min.y(), max.z()), -dz, dy, mat)); // right
-    sides->add(make_shared<quad>(point3(max.x(), min.y(), min.z()), -dx, dy, mat)); // back
-    sides->add(make_shared<quad>(point3(min.x(), min.y(), min.z()), dz, dy, mat)); // front
-    sides->add(make_shared<quad>(point3(min.x(), max.y(), max.z()), dx, -dz, mat)); // top
-    sides->add(make_shared<quad>(point3(min.x(), min.y(), min.z()), dx, dz, mat)); // bottom
+    add_side(point3(min.x(), min.y(), max.z()), dx, dy); // front
+    add_side(point3(max.x(), min.y(), max.z()), -dz, dy); // right
+    add_side(point3(max.x(), min.y(), min.z()), -dx, dy); // back
+    add_side(point3(min.x(), min.y(), min.z()), dz, dy); // front
+    add_side(point3(min.x(), max.y(), max.z()), dx, -dz); // top
+    add_side(point3(min.x(), min.y(), min.z()), dx, dz); // bottom
+}
+
+inline shared_ptr<hittable_list> box(const point3& a, const point3& b, shared_ptr<material> mat) {
+    // Returns the 3D box (six sides) that contains the two opposite vertices a & b.
+    auto sides = make_shared<hittable_list>();
+
+    box_sides(a, b, [&](const point3& Q, const vec3& u, const vec3& v) {
+        sides->add(make_shared<quad>(Q, u, v, mat));
+    });
 
     return sides;
 
@@ -7,29 +7,70 @@
 
 #include "vec3.h"
 
-class ray {
+#include <limits>
+
+template <typename T>
+class basic_ray {
     public:
-        ray() {}
+        basic_ray() {}
 
-        ray(const point3& origin, const vec3& direction, double time) :
-            orig(origin), dir(direction), tm(time) {}
+        basic_ray(const basic_vec3<T>& origin, const basic_vec3<T>& direction, double time) :
+            orig(origin), dir(direction), tm(time),
+            inv_dir(T(1) / direction.x(), T(1) / direction.y(), T(1) / direction.z()),
+            neg{ inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0 } {}
 
-        ray(const point3& origin, const vec3& direction) :
-            ray(origin, direction, 0) {}
+        basic_ray(const basic_vec3<T>& origin, const basic_vec3<T>& direction) :
+            basic_ray(origin, direction, 0) {}
 
-        const point3& origin() const { return orig; }
-        const vec3& direction() const { return dir; }
+        const basic_vec3<T>& origin() const { return orig; }
+        const basic_vec3<T>& direction() const { return dir; }
 
         double time() const {return tm;}
 
-        point3 at(double t) const {
+        // Reciprocal direction and per-axis direction signs, computed once here so that
+        // every box test along the ray is just a subtract and a multiply per slab.
+        const basic_vec3<T>& inv_direction() const { return inv_dir; }
+        bool dir_is_neg(int axis) const { return neg[axis]; }
+
+        basic_vec3<T> at(T t) const {
             return orig + t*dir;
         }
     private:
-        point3 orig;
-        vec3 dir;
+        basic_vec3<T> orig;
+        basic_vec3<T> dir;
         double tm;
+        basic_vec3<T> inv_dir;
+        bool neg[3];
 };
 
+using ray = basic_ray<real>;
+
+template <typename T>
+constexpr T rounding_gamma(int n) {
+    // Bound on the relative error of n successive floating-point operations, as in Pharr,
+    // Jakob and Humphreys, "Physically Based Rendering", 3rd ed., section 3.9.
+    constexpr T unit_roundoff = std::numeric_limits<T>::epsilon() / 2;
+    return (n * unit_roundoff) / (1 - n * unit_roundoff);
+}
+
+template <typename T>
+inline basic_vec3<T> offset_ray_origin(const basic_vec3<T>& p, const basic_vec3<T>& error_offset,
+                                       const basic_vec3<T>& direction) {
+    // Origin for a ray leaving the surface point p in direction. error_offset lies along
+    // the geometric normal and is as long as the bound on p's distance from the true
+    // surface, so p moved by it, or against it for a ray into the surface, is on the
+    // ray's side. Each coordinate is then rounded one ulp further away, so that rounding
+    // in the move itself cannot undo it.
+    auto offset = dot(error_offset, direction) < 0 ? -error_offset : error_offset;
+    auto origin = p + offset;
+    for (int axis = 0; axis < 3; axis++) {
+        if (offset[axis] > 0)
+            origin[axis] = std::nextafter(origin[axis], std::numeric_limits<T>::infinity());
+        else if (offset[axis] < 0)
+            origin[axis] = std::nextafter(origin[axis], -std::numeric_limits<T>::infinity());
+    }
+    return origin;
+}
+
 
 #endif //RAY_H
@@ -0,0 +1,153 @@
+#ifndef RAY_PACKET_H
+#define RAY_PACKET_H
+
+#include "interval.h"
+#include "ray.h"
+
+#include <cstdint>
+#include <utility>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+// Number of rays traced together in packet mode: 4, 8 or 16. Lanes are held in
+// structure-of-arrays form so the per-lane loops below map directly onto SIMD registers.
+#ifndef RT_PACKET_SIZE
+#define RT_PACKET_SIZE 8
+#endif
+
+class ray_packet {
+  public:
+    static constexpr int size = RT_PACKET_SIZE;
+    static_assert(size == 4 || size == 8 || size == 16, "RT_PACKET_SIZE must be 4, 8 or 16");
+
+    using lane_mask = uint32_t;     // Bit i set means lane i takes part
+    static constexpr lane_mask all_lanes = (lane_mask(1) << size) - 1;
+
+    alignas(64) double ox[size], oy[size], oz[size];        // Origins
+    alignas(64) double dx[size], dy[size], dz[size];        // Directions
+    alignas(64) double inv_dx[size], inv_dy[size], inv_dz[size];
+    alignas(64) double tm[size];                            // Ray times
+    alignas(64) double t_min[size], t_max[size];            // t_max shrinks to the closest hit
+
+    lane_mask active = 0;
+
+    void set(int lane, const ray& r, const interval& ray_t) {
+        const auto& o = r.origin();
+        const auto& d = r.direction();
+        const auto& inv = r.inv_direction();
+        ox[lane] = o.x(); oy[lane] = o.y(); oz[lane] = o.z();
+        dx[lane] = d.x(); dy[lane] = d.y(); dz[lane] = d.z();
+        inv_dx[lane] = inv.x(); inv_dy[lane] = inv.y(); inv_dz[lane] = inv.z();
+        tm[lane] = r.time();
+        t_min[lane] = ray_t.min;
+        t_max[lane] = ray_t.max;
+        active |= lane_mask(1) << lane;
+    }
+
+    void clear(int lane) {
+        // Inactive lanes still take part in the SIMD arithmetic, so keep them finite.
+        ox[lane] = oy[lane] = oz[lane] = 0;
+        dx[lane] = dy[lane] = dz[lane] = 1;
+        inv_dx[lane] = inv_dy[lane] = inv_dz[lane] = 1;
+        tm[lane] = 0;
+        t_min[lane] = 0;
+        t_max[lane] = -infinity;
+        active &= ~(lane_mask(1) << lane);
+    }
+
+    ray get(int lane) const {
+        return ray(point3(ox[lane], oy[lane], oz[lane]), vec3(dx[lane], dy[lane], dz[lane]),
+                   tm[lane]);
+    }
+
+    interval lane_interval(int lane) const { return interval(t_min[lane], t_max[lane]); }
+
+    static bool has_lane(lane_mask mask, int lane) { return (mask >> lane) & 1; }
+};
+
+inline ray_packet::lane_mask packet_box_hit(const ray_packet& p, const float bmin[3],
+                                            const float bmax[3]) {
+    // Slab test of one box against every lane. Returns the mask of lanes whose
+    // [t_min, t_max] overlaps the box; the caller intersects it with the live lanes.
+
+    ray_packet::lane_mask mask = 0;
+
+#if defined(__AVX512F__)
+    // Eight lanes per step, so only for packets of at least eight rays; smaller ones take
+    // the AVX2 path below.
+    if constexpr (ray_packet::size >= 8) {
+        const __m512d min_x = _mm512_set1_pd(bmin[0]), max_x = _mm512_set1_pd(bmax[0]);
+        const __m512d min_y = _mm512_set1_pd(bmin[1]), max_y = _mm512_set1_pd(bmax[1]);
+        const __m512d min_z = _mm512_set1_pd(bmin[2]), max_z = _mm512_set1_pd(bmax[2]);
+
+        for (int base = 0; base < ray_packet::size; base += 8) {
+            auto slab = [&](const double* o, const double* inv, __m512d lo, __m512d hi,
+                            __m512d& t_near, __m512d& t_far) {
+                const __m512d ov = _mm512_load_pd(o + base);
+                const __m512d iv = _mm512_load_pd(inv + base);
+                const __m512d t0 = _mm512_mul_pd(_mm512_sub_pd(lo, ov), iv);
+                const __m512d t1 = _mm512_mul_pd(_mm512_sub_pd(hi, ov), iv);
+                t_near = _mm512_max_pd(t_near, _mm512_min_pd(t0, t1));
+                t_far = _mm512_min_pd(t_far, _mm512_max_pd(t0, t1));
+            };
+
+            __m512d t_near = _mm512_load_pd(p.t_min + base);
+            __m512d t_far = _mm512_load_pd(p.t_max + base);
+            slab(p.ox, p.inv_dx, min_x, max_x, t_near, t_far);
+            slab(p.oy, p.inv_dy, min_y, max_y, t_near, t_far);
+            slab(p.oz, p.inv_dz, min_z, max_z, t_near, t_far);
+
+            mask |= ray_packet::lane_mask(_mm512_cmp_pd_mask(t_near, t_far, _CMP_LT_OQ)) << base;
+        }
+        return mask;
+    }
+#endif
+#if defined(__AVX2__)
+    const __m256d min_x = _mm256_set1_pd(bmin[0]), max_x = _mm256_set1_pd(bmax[0]);
+    const __m256d min_y = _mm256_set1_pd(bmin[1]), max_y = _mm256_set1_pd(bmax[1]);
+    const __m256d min_z = _mm256_set1_pd(bmin[2]), max_z = _mm256_set1_pd(bmax[2]);
+
+    for (int base = 0; base < ray_packet::size; base += 4) {
+        auto slab = [&](const double* o, const double* inv, __m256d lo, __m256d hi,
+                        __m256d& t_near, __m256d& t_far) {
+            const __m256d ov = _mm256_load_pd(o + base);
+            const __m256d iv = _mm256_load_pd(inv + base);
+            const __m256d t0 = _mm256_mul_pd(_mm256_sub_pd(lo, ov), iv);
+            const __m256d t1 = _mm256_mul_pd(_mm256_sub_pd(hi, ov), iv);
+            t_near = _mm256_max_pd(t_near, _mm256_min_pd(t0, t1));
+            t_far = _mm256_min_pd(t_far, _mm256_max_pd(t0, t1));
+        };
+
+        __m256d t_near = _mm256_load_pd(p.t_min + base);
+        __m256d t_far = _mm256_load_pd(p.t_max + base);
+        slab(p.ox, p.inv_dx, min_x, max_x, t_near, t_far);
+        slab(p.oy, p.inv_dy, min_y, max_y, t_near, t_far);
+        slab(p.oz, p.inv_dz, min_z, max_z, t_near, t_far);
+
+        auto lanes = _mm256_movemask_pd(_mm256_cmp_pd(t_near, t_far, _CMP_LT_OQ));
+        mask |= ray_packet::lane_mask(lanes) << base;
+    }
+#else
+    const double* orig[3] = { p.ox, p.oy, p.oz };
+    const double* inv[3] = { p.inv_dx, p.inv_dy, p.inv_dz };
+
+    for (int lane = 0; lane < ray_packet::size; lane++) {
+        auto t_near = p.t_min[lane];
+        auto t_far = p.t_max[lane];
+        for (int axis = 0; axis < 3; axis++) {
+            auto t0 = (bmin[axis] - orig[axis][lane]) * inv[axis][lane];
+            auto t1 = (bmax[axis] - orig[axis][lane]) * inv[axis][lane];
+            if (t0 > t1) std::swap(t0, t1);
+            t_near = t0 > t_near ? t0 : t_near;
+            t_far = t1 < t_far ? t1 : t_far;
+        }
+        mask |= ray_packet::lane_mask(t_near < t_far) << lane;
+    }
+#endif
+
+    return mask;
+}
+
+#endif //RAY_PACKET_H
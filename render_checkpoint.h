@@ -0,0 +1,200 @@
+#ifndef RENDER_CHECKPOINT_H
+#define RENDER_CHECKPOINT_H
+
+#include "pixel_stats.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define RT_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Binary snapshot of a progressive render, or of one shard of a distributed render: a
+// fixed header followed by the accumulation buffer, one pixel_stats record per pixel in
+// row-major order. The records are stored
+// exactly as they are held in memory, so a resumed render continues from the same sums
+// and reproduces an uninterrupted run bit for bit. No generator state needs saving, since
+// every sample reseeds from (seed, pixel, sample index); the seed and the number of
+// completed passes pin it down.
+
+static_assert(std::is_trivially_copyable<pixel_stats>::value,
+              "pixel_stats is saved and loaded as raw bytes");
+
+struct checkpoint_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;       // sizeof(pixel_stats), guards against layout changes
+    uint32_t width;
+    uint32_t height;
+    uint32_t pass_samples;
+    uint32_t passes_done;
+    uint64_t seed;
+    uint64_t fingerprint;       // Hash of the settings that decide which samples are taken
+    uint32_t shard_index;       // Which part of a sharded render this holds
+    uint32_t shard_count;       // 1 for an unsharded render
+    uint32_t shard_split;       // A shard_split value
+    uint32_t reserved;
+
+    static constexpr char expected_magic[8] = { 'R', 'T', 'C', 'K', 'P', 'T', '\0', '\0' };
+    static constexpr uint32_t current_version = 2;
+};
+
+class checkpoint_fingerprint {
+  public:
+    // FNV-1a over the raw bytes of each setting added.
+    template <typename T>
+    checkpoint_fingerprint& add(const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "fingerprints hash raw bytes");
+        const auto* bytes = reinterpret_cast<const unsigned char*>(&value);
+        for (size_t i = 0; i < sizeof(T); i++) {
+            hash ^= bytes[i];
+            hash *= 0x100000001b3ULL;
+        }
+        return *this;
+    }
+
+    uint64_t value() const { return hash; }
+
+  private:
+    uint64_t hash = 0xcbf29ce484222325ULL;
+};
+
+class render_checkpoint {
+  public:
+    static bool save(const std::string& path, checkpoint_header header,
+                     const std::vector<pixel_stats>& pixels) {
+        // Written under a temporary name and renamed into place, so a node killed
+        // mid-write leaves the previous checkpoint intact.
+        std::memcpy(header.magic, checkpoint_header::expected_magic, sizeof(header.magic));
+        header.version = checkpoint_header::current_version;
+        header.record_size = sizeof(pixel_stats);
+
+        const size_t data_size = pixels.size() * sizeof(pixel_stats);
+        const std::string temp_path = path + ".tmp";
+
+        bool written = false;
+#ifdef RT_HAVE_MMAP
+        written = save_mapped(temp_path, header, pixels.data(), data_size);
+#endif
+        if (!written)
+            written = save_stream(temp_path, header, pixels.data(), data_size);
+        if (!written) {
+            std::cerr << "ERROR: Could not write checkpoint '" << temp_path << "'.\n";
+            return false;
+        }
+
+        if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+            std::remove(path.c_str());
+            if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+                std::cerr << "ERROR: Could not rename checkpoint to '" << path << "'.\n";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static bool load(const std::string& path, checkpoint_header& header,
+                     std::vector<pixel_stats>& pixels) {
+        // Returns false, leaving the outputs unspecified, if the file is missing, truncated
+        // or was written by an incompatible build.
+#ifdef RT_HAVE_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        size_t size = 0;
+        void* mapped = MAP_FAILED;
+        if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+            size = size_t(st.st_size);
+            mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        ::close(fd);
+        if (mapped == MAP_FAILED)
+            return false;
+
+        bool ok = parse(static_cast<const char*>(mapped), size, header, pixels);
+        ::munmap(mapped, size);
+        return ok;
+#else
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+            return false;
+        std::vector<char> bytes((std::istreambuf_iterator<char>(in)),
+                                std::istreambuf_iterator<char>());
+        return parse(bytes.data(), bytes.size(), header, pixels);
+#endif
+    }
+
+  private:
+    static bool parse(const char* data, size_t size, checkpoint_header& header,
+                      std::vector<pixel_stats>& pixels) {
+        if (size < sizeof(checkpoint_header))
+            return false;
+        std::memcpy(&header, data, sizeof(header));
+
+        if (std::memcmp(header.magic, checkpoint_header::expected_magic, sizeof(header.magic)) != 0
+            || header.version != checkpoint_header::current_version
+            || header.record_size != sizeof(pixel_stats))
+            return false;
+
+        const size_t count = size_t(header.width) * header.height;
+        if (size != sizeof(checkpoint_header) + count * sizeof(pixel_stats))
+            return false;
+
+        pixels.resize(count);
+        std::memcpy(pixels.data(), data + sizeof(checkpoint_header), count * sizeof(pixel_stats));
+        return true;
+    }
+
+    static bool save_stream(const std::string& path, const checkpoint_header& header,
+                            const void* data, size_t data_size) {
+        std::ofstream out(path, std::ios::binary);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(static_cast<const char*>(data), data_size);
+        out.flush();
+        return bool(out);
+    }
+
+#ifdef RT_HAVE_MMAP
+    static bool save_mapped(const std::string& path, const checkpoint_header& header,
+                            const void* data, size_t data_size) {
+        // Map the file and copy straight into the page cache, with no stream buffering.
+        // msync makes the snapshot durable before it replaces the previous one, since a
+        // preempted node may lose the page cache along with the process.
+        const size_t size = sizeof(header) + data_size;
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return false;
+        if (::ftruncate(fd, off_t(size)) != 0) {
+            ::close(fd);
+            return false;
+        }
+
+        void* mapped = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED)
+            return false;
+
+        auto* out = static_cast<char*>(mapped);
+        std::memcpy(out, &header, sizeof(header));
+        std::memcpy(out + sizeof(header), data, data_size);
+        bool synced = ::msync(mapped, size, MS_SYNC) == 0;
+        ::munmap(mapped, size);
+        return synced;
+    }
+#endif
+};
+
+#endif //RENDER_CHECKPOINT_H
@@ -0,0 +1,130 @@
+#ifndef RENDER_SHARD_H
+#define RENDER_SHARD_H
+
+#include "image_writer.h"
+#include "render_checkpoint.h"
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define RT_HAVE_FORK 1
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// Distributed rendering with plain files. A frame is split into shards, each rendered by
+// its own process into a partial accumulation buffer (a render_checkpoint file with zero
+// samples outside the shard). Merging adds the shards' sample sums pixel by pixel, so the
+// result is the image a single process would have produced.
+
+enum class shard_split : uint32_t {
+    regions,    // Each shard renders every shard_count-th tile, at full sample count
+    samples     // Each shard renders a slice of the progressive passes, for every pixel
+};
+
+inline std::string shard_file_name(const std::string& base, int index) {
+    return base + ".shard" + std::to_string(index);
+}
+
+inline bool merge_shards(const std::vector<std::string>& paths, checkpoint_header& merged,
+                         std::vector<pixel_stats>& pixels) {
+    // Sums the accumulations of a complete set of shards into pixels. Fails if a shard is
+    // missing, unreadable or from a different render.
+    std::vector<bool> seen;
+    std::vector<pixel_stats> shard;
+
+    for (size_t k = 0; k < paths.size(); k++) {
+        checkpoint_header header;
+        if (!render_checkpoint::load(paths[k], header, shard)) {
+            std::cerr << "ERROR: Could not read shard '" << paths[k] << "'.\n";
+            return false;
+        }
+
+        if (k == 0) {
+            merged = header;
+            pixels.assign(shard.size(), pixel_stats());
+            seen.assign(header.shard_count, false);
+        } else if (header.width != merged.width || header.height != merged.height
+                   || header.pass_samples != merged.pass_samples || header.seed != merged.seed
+                   || header.fingerprint != merged.fingerprint
+                   || header.shard_count != merged.shard_count
+                   || header.shard_split != merged.shard_split) {
+            std::cerr << "ERROR: Shard '" << paths[k] << "' belongs to a different render.\n";
+            return false;
+        }
+
+        if (header.shard_index >= seen.size() || seen[header.shard_index]) {
+            std::cerr << "ERROR: Shard '" << paths[k] << "' is out of range or repeated.\n";
+            return false;
+        }
+        seen[header.shard_index] = true;
+        merged.passes_done = std::max(merged.passes_done, header.passes_done);
+
+        for (size_t i = 0; i < pixels.size(); i++)
+            pixels[i].merge(shard[i]);
+    }
+
+    if (paths.empty() || paths.size() != seen.size()) {
+        std::cerr << "ERROR: Expected " << seen.size() << " shards, got " << paths.size()
+                  << ".\n";
+        return false;
+    }
+
+    merged.shard_index = 0;
+    merged.shard_count = 1;
+    return true;
+}
+
+inline framebuffer resolve_accumulation(const checkpoint_header& header,
+                                        const std::vector<pixel_stats>& pixels) {
+    framebuffer image(int(header.width), int(header.height));
+    for (int j = 0; j < image.height(); j++)
+        for (int i = 0; i < image.width(); i++)
+            image.set(i, j, pixels[size_t(j) * image.width() + i].average());
+    return image;
+}
+
+inline int run_local_workers(int count, const std::function<int(int)>& worker) {
+    // Runs worker(0) ... worker(count - 1) in separate processes and waits for them all.
+    // Returns the number that failed. Call it before the parent has started any OpenMP
+    // work, since a thread pool does not survive fork. Without fork the workers simply
+    // run one after another in this process.
+    int failures = 0;
+
+#ifdef RT_HAVE_FORK
+    std::vector<pid_t> children;
+    for (int k = 0; k < count; k++) {
+        pid_t pid = ::fork();
+        if (pid == 0) {
+            int status = worker(k);
+            std::cout.flush();
+            std::clog.flush();
+            ::_exit(status);
+        }
+        if (pid < 0) {
+            std::cerr << "ERROR: Could not start worker " << k << ".\n";
+            failures++;
+            continue;
+        }
+        children.push_back(pid);
+    }
+
+    for (auto pid : children) {
+        int status = 0;
+        if (::waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            failures++;
+    }
+#else
+    for (int k = 0; k < count; k++)
+        if (worker(k) != 0)
+            failures++;
+#endif
+
+    return failures;
+}
+
+#endif //RENDER_SHARD_H
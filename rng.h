@@ -0,0 +1,73 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <cstdint>
+
+// xoshiro256+ (Blackman & Vigna). Small state, no locking, and the weak low bits are the
+// ones we throw away when building a 53-bit double. Seeds are expanded with splitmix64 so
+// that neighbouring seeds (consecutive pixel or sample indices) give unrelated streams.
+
+class rng {
+  public:
+    constexpr rng() : state{} { seed(default_seed); }
+    constexpr explicit rng(uint64_t s) : state{} { seed(s); }
+
+    constexpr void seed(uint64_t s) {
+        for (auto& word : state)
+            word = splitmix64(s);
+    }
+
+    constexpr void seed(uint64_t s, uint64_t stream, uint64_t index) {
+        // Derive an independent stream for (seed, stream, index), e.g. (image seed, pixel, sample).
+        // Each step goes through splitmix64's output function, so the key is not a linear
+        // function of its inputs and different (seed, stream) pairs do not collide.
+        auto h = s;
+        h = splitmix64(h) ^ (stream * 0x9e3779b97f4a7c15ULL);
+        h = splitmix64(h) ^ (index * 0xc2b2ae3d27d4eb4fULL);
+        seed(h);
+    }
+
+    constexpr uint64_t next() {
+        const uint64_t result = state[0] + state[3];
+        const uint64_t t = state[1] << 17;
+
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 45);
+
+        return result;
+    }
+
+    double next_double() {
+        // Return x in [0,1) using the top 53 bits.
+        return double(next() >> 11) * 0x1.0p-53;
+    }
+
+    static constexpr uint64_t default_seed = 0x853c49e6748fea9bULL;
+
+  private:
+    uint64_t state[4];
+
+    static constexpr uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    static constexpr uint64_t splitmix64(uint64_t& x) {
+        uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+};
+
+inline rng& thread_rng() {
+    // Every thread owns its generator, so there is no shared state to contend on. The
+    // generator is constant-initialized, so access needs no thread_local guard.
+    static thread_local rng generator;
+    return generator;
+}
+
+#endif //RNG_H
@@ -11,15 +11,25 @@
 #include <limits>
 #include <memory>
 
+#include "rng.h"
+
 // C++ Std Using
 
 using std::make_shared;
 using std::shared_ptr;
 
+// Scalar type of the geometry and ray math: double, or float when built with RT_FLOAT.
+
+#ifdef RT_FLOAT
+using real = float;
+#else
+using real = double;
+#endif
+
 // Constants
 
-const double infinity = std::numeric_limits<double>::infinity();
-const double pi =  3.1415926535897932385;
+constexpr double infinity = std::numeric_limits<double>::infinity();
+constexpr double pi =  3.1415926535897932385;
 
 // Utility Functions
 
@@ -32,8 +42,8 @@ inline double radians_2_degrees(double radians) {
 }
 
 inline double random_double() {
-    // Return random x in range [0,1)
-    return std::rand() / (RAND_MAX + 1.0);
+    // Return random x in range [0,1) from the calling thread's generator
+    return thread_rng().next_double();
 }
 
 inline double random_double(double min, double max) {
@@ -46,6 +56,12 @@ inline int random_int(int min, int max) {
     return int(random_double(min, max+1));
 }
 
+inline void seed_random(uint64_t seed, uint64_t stream, uint64_t index) {
+    // Reseed the calling thread's generator. Rendering reseeds per (pixel, sample) so an
+    // image only depends on its seed, not on which thread traced which pixel.
+    thread_rng().seed(seed, stream, index);
+}
+
 // Common Headers
 
 #include "color.h"
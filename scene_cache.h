@@ -0,0 +1,372 @@
+#ifndef SCENE_CACHE_H
+#define SCENE_CACHE_H
+
+#include "camera.h"
+#include "hittable_list.h"
+#include "linear_bvh.h"
+#include "mapped_file.h"
+#include "material.h"
+#include "quad.h"
+#include "sphere.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+// Binary cache of a loaded scene, so that re-rendering an unchanged scene file skips
+// parsing and the BVH build. The file holds a header (with the camera settings and the
+// size and time of the scene file it came from), then four flat arrays: materials,
+// primitives in BVH leaf order, linear_bvh nodes, and the shapes of the lights. It is
+// mapped read-only and traced in place by cached_scene; loading allocates one object per
+// material and per light, and nothing per primitive.
+//
+// Only scenes made of spheres, quads and boxes with untextured materials can be cached.
+// Anything else (textures, instances, media) is loaded from the scene file as usual.
+
+enum class cached_material_kind : uint32_t { lambertian, metal, dielectric, light, isotropic };
+
+struct cached_material {
+    uint32_t kind;          // A cached_material_kind value
+    uint32_t pad;
+    double albedo[3];       // Albedo, or emitted radiance for lights
+    double param;           // Metal fuzz or dielectric refraction index
+};
+
+enum class cached_shape : uint32_t { sphere, quad };
+
+struct cached_primitive {
+    uint32_t shape;             // A cached_shape value
+    uint32_t material_index;    // Into the material table; unused for lights
+    double p[3];                // Sphere: center at time 0. Quad: corner Q.
+    double u[3];                // Sphere: motion over the shutter interval. Quad: first edge.
+    double v[3];                // Sphere: radius in v[0]. Quad: second edge.
+    double w[3];                // Quad only: the plane terms quad's constructor derives
+    double normal[3];
+    double D;
+
+    static cached_primitive make_sphere(const point3& center1, const point3& center2,
+                                        double radius, uint32_t material_index) {
+        cached_primitive prim = {};
+        prim.shape = uint32_t(cached_shape::sphere);
+        prim.material_index = material_index;
+        store(prim.p, center1);
+        store(prim.u, center2 - center1);
+        prim.v[0] = std::fmax(0, radius);
+        return prim;
+    }
+
+    static cached_primitive make_quad(const point3& Q, const vec3& u, const vec3& v,
+                                      uint32_t material_index) {
+        cached_primitive prim = {};
+        prim.shape = uint32_t(cached_shape::quad);
+        prim.material_index = material_index;
+        store(prim.p, Q);
+        store(prim.u, u);
+        store(prim.v, v);
+
+        auto n = cross(u, v);
+        auto normal = unit_vector(n);
+        store(prim.w, n / dot(n, n));
+        store(prim.normal, normal);
+        prim.D = dot(normal, Q);
+        return prim;
+    }
+
+    static void store(double* out, const vec3& v) {
+        out[0] = v.x();
+        out[1] = v.y();
+        out[2] = v.z();
+    }
+
+    static vec3 load(const double* in) { return vec3(in[0], in[1], in[2]); }
+
+    aabb bounding_box() const {
+        // The same boxes sphere and quad compute, so the cached BVH matches linear_bvh's.
+        if (shape == uint32_t(cached_shape::sphere)) {
+            auto rvec = vec3(v[0], v[0], v[0]);
+            auto center1 = load(p);
+            auto center2 = center1 + load(u);
+            return aabb(aabb(center1 - rvec, center1 + rvec), aabb(center2 - rvec, center2 + rvec));
+        }
+        auto Q = load(p), e1 = load(u), e2 = load(v);
+        return aabb(aabb(Q, Q + e1 + e2), aabb(Q + e1, Q + e2));
+    }
+
+    bool hit(const material* mat, const ray& r, interval ray_t, hit_record& rec) const {
+        if (shape == uint32_t(cached_shape::sphere))
+            return sphere::hit_sphere(load(p), load(u), v[0], mat, r, ray_t, rec);
+        return quad::hit_quad(load(p), load(u), load(v), load(w), load(normal), D, mat, r,
+                              ray_t, rec);
+    }
+
+    shared_ptr<hittable> make_light() const {
+        // The shape alone, for the lights list sampled by hittable_pdf.
+        if (shape == uint32_t(cached_shape::sphere))
+            return make_shared<sphere>(load(p), v[0], shared_ptr<material>());
+        return make_shared<quad>(load(p), load(u), load(v), shared_ptr<material>());
+    }
+};
+
+struct cached_camera {
+    double aspect_ratio;
+    int32_t image_width;
+    int32_t samples_per_pixel;
+    int32_t max_depth;
+    int32_t pad;
+    double background[3];
+    double vfov;
+    double lookfrom[3];
+    double lookat[3];
+    double vup[3];
+    double defocus_angle;
+    double focus_dist;
+    uint64_t seed;
+
+    static cached_camera from(const camera& cam) {
+        cached_camera c = {};
+        c.aspect_ratio = cam.aspect_ratio;
+        c.image_width = cam.image_width;
+        c.samples_per_pixel = cam.samples_per_pixel;
+        c.max_depth = cam.max_depth;
+        cached_primitive::store(c.background, cam.background);
+        c.vfov = cam.vfov;
+        cached_primitive::store(c.lookfrom, cam.lookfrom);
+        cached_primitive::store(c.lookat, cam.lookat);
+        cached_primitive::store(c.vup, cam.vup);
+        c.defocus_angle = cam.defocus_angle;
+        c.focus_dist = cam.focus_dist;
+        c.seed = cam.seed;
+        return c;
+    }
+
+    void apply(camera& cam) const {
+        cam.aspect_ratio = aspect_ratio;
+        cam.image_width = image_width;
+        cam.samples_per_pixel = samples_per_pixel;
+        cam.max_depth = max_depth;
+        cam.background = cached_primitive::load(background);
+        cam.vfov = vfov;
+        cam.lookfrom = cached_primitive::load(lookfrom);
+        cam.lookat = cached_primitive::load(lookat);
+        cam.vup = cached_primitive::load(vup);
+        cam.defocus_angle = defocus_angle;
+        cam.focus_dist = focus_dist;
+        cam.seed = seed;
+    }
+};
+
+struct scene_cache_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t primitive_size;    // sizeof(cached_primitive), guards against layout changes
+    uint64_t source_size;       // Size and modification time of the scene file
+    int64_t source_time;
+    uint64_t material_count;
+    uint64_t primitive_count;
+    uint64_t node_count;
+    uint64_t light_count;
+    cached_camera camera_settings;
+
+    static constexpr char expected_magic[8] = { 'R', 'T', 'S', 'C', 'E', 'N', 'E', '\0' };
+    static constexpr uint32_t current_version = 1;
+};
+
+static_assert(std::is_trivially_copyable<cached_primitive>::value
+              && std::is_trivially_copyable<cached_material>::value
+              && std::is_trivially_copyable<scene_cache_header>::value,
+              "scene cache records are saved and mapped as raw bytes");
+static_assert(sizeof(scene_cache_header) % 8 == 0 && sizeof(cached_material) % 8 == 0
+              && sizeof(cached_primitive) % 8 == 0 && sizeof(linear_bvh_node) % 8 == 0,
+              "scene cache arrays must stay 8-byte aligned in the file");
+
+inline bool scene_source_stamp(const std::string& path, uint64_t& size, int64_t& time) {
+    // Identifies a version of a scene file without reading it.
+    std::error_code error;
+    auto file_size = std::filesystem::file_size(path, error);
+    if (error)
+        return false;
+    auto write_time = std::filesystem::last_write_time(path, error);
+    if (error)
+        return false;
+    size = uint64_t(file_size);
+    time = int64_t(write_time.time_since_epoch().count());
+    return true;
+}
+
+class cached_scene : public hittable {
+  public:
+    // Traces the primitives and BVH of a scene cache where they lie in the mapped file.
+    cached_scene(std::unique_ptr<mapped_file> file, const scene_cache_header& header)
+      : file(std::move(file))
+    {
+        const char* data = this->file->data() + sizeof(scene_cache_header);
+        auto material_records = reinterpret_cast<const cached_material*>(data);
+        data += header.material_count * sizeof(cached_material);
+        primitives = reinterpret_cast<const cached_primitive*>(data);
+        data += header.primitive_count * sizeof(cached_primitive);
+        nodes = reinterpret_cast<const linear_bvh_node*>(data);
+        node_count = size_t(header.node_count);
+
+        for (uint64_t k = 0; k < header.material_count; k++)
+            materials.push_back(make_material(material_records[k]));
+        for (const auto& mat : materials)
+            material_ptrs.push_back(mat.get());
+
+        bbox = node_count > 0 ? nodes[0].bounds() : aabb::empty;
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        if (node_count == 0)
+            return false;
+
+        return traverse_linear_bvh(nodes, r, ray_t,
+            [&](uint32_t first, uint32_t count, interval& t) {
+                bool hit_leaf = false;
+                for (uint32_t i = first; i < first + count; i++) {
+                    const auto& prim = primitives[i];
+                    if (prim.hit(material_ptrs[prim.material_index], r, t, rec)) {
+                        hit_leaf = true;
+                        t.max = rec.t;
+                    }
+                }
+                return hit_leaf;
+            });
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    static shared_ptr<material> make_material(const cached_material& m) {
+        auto albedo = cached_primitive::load(m.albedo);
+        switch (cached_material_kind(m.kind)) {
+            case cached_material_kind::metal:      return make_shared<metal>(albedo, m.param);
+            case cached_material_kind::dielectric: return make_shared<dielectric>(m.param);
+            case cached_material_kind::light:      return make_shared<diffuse_light>(albedo);
+            case cached_material_kind::isotropic:  return make_shared<isotropic>(albedo);
+            default:                               return make_shared<lambertian>(albedo);
+        }
+    }
+
+  private:
+    std::unique_ptr<mapped_file> file;
+    const cached_primitive* primitives = nullptr;
+    const linear_bvh_node* nodes = nullptr;
+    size_t node_count = 0;
+    std::vector<shared_ptr<material>> materials;
+    std::vector<const material*> material_ptrs;
+    aabb bbox;
+};
+
+class scene_cache {
+  public:
+    static bool save(const std::string& path, scene_cache_header header,
+                     const std::vector<cached_material>& materials,
+                     const std::vector<cached_primitive>& primitives,
+                     const std::vector<cached_primitive>& lights,
+                     const bvh_build_options& options) {
+        // Builds the BVH over the primitives and writes the cache, under a temporary name
+        // renamed into place so that a concurrent reader never maps a partial file.
+        std::vector<aabb> bounds;
+        bounds.reserve(primitives.size());
+        for (const auto& prim : primitives)
+            bounds.push_back(prim.bounding_box());
+
+        std::vector<linear_bvh_node> nodes;
+        std::vector<uint32_t> order;
+        bvh_builder::build(bounds, options, nodes, order);
+
+        std::memcpy(header.magic, scene_cache_header::expected_magic, sizeof(header.magic));
+        header.version = scene_cache_header::current_version;
+        header.primitive_size = sizeof(cached_primitive);
+        header.material_count = materials.size();
+        header.primitive_count = primitives.size();
+        header.node_count = nodes.size();
+        header.light_count = lights.size();
+
+        const std::string temp_path = path + ".tmp";
+        {
+            std::ofstream out(temp_path, std::ios::binary);
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            write_array(out, materials);
+
+            // Primitives go in leaf order, in chunks to bound the extra memory.
+            std::vector<cached_primitive> chunk;
+            chunk.reserve(4096);
+            for (size_t k = 0; k < order.size(); k++) {
+                chunk.push_back(primitives[order[k]]);
+                if (chunk.size() == chunk.capacity() || k + 1 == order.size()) {
+                    write_array(out, chunk);
+                    chunk.clear();
+                }
+            }
+
+            write_array(out, nodes);
+            write_array(out, lights);
+            out.flush();
+            if (!out) {
+                std::cerr << "ERROR: Could not write scene cache '" << temp_path << "'.\n";
+                return false;
+            }
+        }
+
+        if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+            std::remove(path.c_str());
+            if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+                std::cerr << "ERROR: Could not rename scene cache to '" << path << "'.\n";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static bool load(const std::string& path, uint64_t source_size, int64_t source_time,
+                     scene_cache_header& header, shared_ptr<hittable>& world,
+                     hittable_list& lights) {
+        // Returns false if the cache is missing, stale (built from another version of the
+        // scene file) or was written by an incompatible build.
+        auto file = std::make_unique<mapped_file>();
+        if (!file->open(path) || file->size() < sizeof(scene_cache_header))
+            return false;
+        std::memcpy(&header, file->data(), sizeof(header));
+
+        if (std::memcmp(header.magic, scene_cache_header::expected_magic, sizeof(header.magic)) != 0
+            || header.version != scene_cache_header::current_version
+            || header.primitive_size != sizeof(cached_primitive)
+            || header.source_size != source_size || header.source_time != source_time)
+            return false;
+
+        const uint64_t expected_size = sizeof(scene_cache_header)
+                                     + header.material_count * sizeof(cached_material)
+                                     + header.primitive_count * sizeof(cached_primitive)
+                                     + header.node_count * sizeof(linear_bvh_node)
+                                     + header.light_count * sizeof(cached_primitive);
+        if (file->size() != expected_size)
+            return false;
+
+        // The arrays are used as they are, without reading them through, so that opening a
+        // large cache costs no more than mapping it.
+        auto light_records = reinterpret_cast<const cached_primitive*>(
+            file->data() + file->size() - header.light_count * sizeof(cached_primitive));
+        lights.clear();
+        for (uint64_t k = 0; k < header.light_count; k++)
+            lights.add(light_records[k].make_light());
+
+        world = make_shared<cached_scene>(std::move(file), header);
+        return true;
+    }
+
+  private:
+    template <typename T>
+    static void write_array(std::ofstream& out, const std::vector<T>& values) {
+        out.write(reinterpret_cast<const char*>(values.data()),
+                  std::streamsize(values.size() * sizeof(T)));
+    }
+};
+
+#endif //SCENE_CACHE_H
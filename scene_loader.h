@@ -0,0 +1,776 @@
+#ifndef SCENE_LOADER_H
+#define SCENE_LOADER_H
+
+#include "camera.h"
+#include "constant_medium.h"
+#include "hittable_list.h"
+#include "instance_tlas.h"
+#include "linear_bvh.h"
+#include "material.h"
+#include "mesh_loader.h"
+#include "quad.h"
+#include "scene_cache.h"
+#include "sphere.h"
+#include "sphere_set.h"
+#include "texture.h"
+#include "transform.h"
+#include "wide_bvh.h"
+
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Text scene files. Each line is one statement; '#' starts a comment. Names are defined
+// once, before use, and everything is built as it is read, in a single pass over the file.
+// Relative mesh and image file names are relative to the scene file.
+//
+//   camera   key value... (aspect, width, spp, depth, background r g b, vfov,
+//                          lookfrom x y z, lookat x y z, vup x y z, defocus, focus, seed)
+//   texture  NAME solid r g b | checker SCALE EVEN ODD | image FILE | noise SCALE
+//   material NAME lambertian C | metal r g b FUZZ | dielectric IOR | light C | isotropic C
+//   sphere   MAT x y z RADIUS [to x y z]     (to: center at time 1, for motion blur)
+//   quad     MAT qx qy qz ux uy uz vx vy vz
+//   box      MAT ax ay az bx by bz
+//   mesh     MAT FILE                        (.obj or binary .ply, relative to this file)
+//   light    sphere x y z RADIUS | quad qx qy qz ux uy uz vx vy vz
+//   object   NAME begin ... end               (a group, added only through instance; 16 or
+//                                              more static spheres in it form a sphere_set)
+//   instance NAME [OP]...  (OP: translate x y z, rotate_y DEG, rotate ax ay az DEG,
+//                           scale x y z, medium DENSITY C)
+//   accel    none | median | sah | bvh4 | bvh8 (top level; default sah; bvh4 and bvh8
+//                                              collapse the SAH tree into 4 or 8 wide nodes)
+//
+// Top-level instances without a medium go into an instance_tlas, so each object's geometry
+// is stored once however many times it is placed.
+//
+// where C is a texture name or an r g b color. light adds a shape to the list of lights
+// sampled directly; it should coincide with an emissive primitive in the scene.
+//
+// Given a cache path, load_scene reuses a scene_cache built from the same version of the
+// file, and otherwise writes one if the scene can be cached.
+
+struct scene_description {
+    hittable_list world;        // Ready to render; holds the top-level BVH unless accel none
+    hittable_list lights;
+    camera cam;
+    size_t primitive_count = 0;
+    double parse_seconds = 0;   // Reading and parsing, including group BVHs
+    double build_seconds = 0;   // Building the top-level BVH, or writing the cache
+    bool from_cache = false;
+};
+
+class scene_parser {
+  public:
+    scene_parser(const std::string& text, const std::string& source_name, bool record_cache)
+      : p(text.c_str()), end(text.c_str() + text.size()), source(source_name),
+        record_cache(record_cache)
+    {
+        bvh_options.method = bvh_split_method::sah;
+    }
+
+    bool parse(scene_description& scene) {
+        out = &scene;
+        target = &primitives;
+
+        while (p < end) {
+            if (!at_line_end() && !statement())
+                return false;
+            if (!at_line_end())
+                return fail("unexpected '" + std::string(word()) + "'");
+            next_line();
+        }
+
+        if (!group_name.empty())
+            return fail("object '" + group_name + "' is missing its end");
+
+        scene.primitive_count = primitive_count;
+        return true;
+    }
+
+    void build_world(scene_description& scene) {
+        // The top level of the parsed scene, under a BVH unless accel none.
+        auto build_start = std::chrono::steady_clock::now();
+        if (use_bvh && !primitives.objects.empty()) {
+            if (bvh_width == 4)
+                scene.world.add(make_shared<bvh4>(primitives, bvh_options));
+            else if (bvh_width == 8)
+                scene.world.add(make_shared<bvh8>(primitives, bvh_options));
+            else
+                scene.world.add(make_shared<linear_bvh>(primitives, bvh_options));
+        }
+        else
+            scene.world = primitives;
+        if (instances->instance_count() > 0) {
+            instances->build(bvh_options);
+            scene.world.add(instances);
+        }
+        scene.build_seconds = seconds_since(build_start);
+    }
+
+    bool save_cache(const std::string& path, const scene_description& scene,
+                    uint64_t source_size, int64_t source_time) {
+        // Writes the records gathered while parsing; false if the scene cannot be cached.
+        if (!uncacheable.empty()) {
+            std::clog << "Not caching " << source << ": " << uncacheable << ".\n";
+            return false;
+        }
+        scene_cache_header header = {};
+        header.source_size = source_size;
+        header.source_time = source_time;
+        header.camera_settings = cached_camera::from(scene.cam);
+        return scene_cache::save(path, header, cache_materials, cache_primitives, cache_lights,
+                                 bvh_options);
+    }
+
+  private:
+    const char* p;
+    const char* end;
+    int line = 1;
+    std::string source;
+
+    scene_description* out = nullptr;
+    hittable_list primitives;           // Top-level primitives
+    hittable_list* target;              // Where primitives go: the top level or a group
+    hittable_list group;
+
+    struct pending_sphere {
+        point3 center;
+        double radius;
+        shared_ptr<material> mat;
+    };
+
+    std::vector<pending_sphere> group_spheres;    // Static spheres of the current group
+    static constexpr size_t min_sphere_set_size = 16;
+    shared_ptr<instance_tlas> instances = make_shared<instance_tlas>();
+    std::string group_name;
+    size_t primitive_count = 0;
+
+    bool use_bvh = true;
+    int bvh_width = 2;                  // 4 or 8 for a wide top-level BVH
+    bvh_build_options bvh_options;
+
+    struct texture_entry {
+        shared_ptr<texture> tex;
+        bool solid = false;         // A plain color, which the scene cache can store
+        color value;
+    };
+
+    struct material_entry {
+        shared_ptr<material> mat;
+        uint32_t cache_index;       // Into cache_materials, or no_cache_index
+    };
+
+    static constexpr uint32_t no_cache_index = UINT32_MAX;
+
+    std::unordered_map<std::string, texture_entry> textures;
+    std::unordered_map<std::string, material_entry> materials;
+    std::unordered_map<std::string, shared_ptr<hittable>> objects;
+
+    // Flat copies of the top level for the scene cache, kept only when one is wanted.
+    bool record_cache;
+    std::string uncacheable;        // Why the scene cannot be cached, if it cannot
+    std::vector<cached_material> cache_materials;
+    std::vector<cached_primitive> cache_primitives;
+    std::vector<cached_primitive> cache_lights;
+
+    static double seconds_since(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Tokens
+
+    bool at_line_end() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+            p++;
+        return p >= end || *p == '\n' || *p == '#';
+    }
+
+    void next_line() {
+        while (p < end && *p != '\n')
+            p++;
+        if (p < end) {
+            p++;
+            line++;
+        }
+    }
+
+    std::string_view word() {
+        if (at_line_end())
+            return {};
+        auto start = p;
+        while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n' && *p != '#')
+            p++;
+        return std::string_view(start, size_t(p - start));
+    }
+
+    bool fail(const std::string& message) {
+        std::cerr << "ERROR: " << source << ":" << line << ": " << message << '\n';
+        return false;
+    }
+
+    bool number(double& value) {
+        if (at_line_end())
+            return fail("expected a number");
+        char* number_end;
+        value = std::strtod(p, &number_end);
+        if (number_end == p)
+            return fail("expected a number, got '" + std::string(word()) + "'");
+        p = number_end;
+        return true;
+    }
+
+    bool count(int& value) {
+        // A whole number of at least 1, such as an image width or a sample count.
+        if (at_line_end())
+            return fail("expected a number");
+        auto start = p;
+        double d;
+        if (!number(d))
+            return false;
+        if (!(d >= 1 && d <= std::numeric_limits<int>::max()) || d != std::floor(d))
+            return fail("expected a whole number from 1 up, got '"
+                        + std::string(start, size_t(p - start)) + "'");
+        value = int(d);
+        return true;
+    }
+
+    bool number(uint64_t& value) {
+        // A full 64-bit unsigned integer, parsed exactly rather than through a double.
+        auto text = std::string(word());
+        if (text.empty())
+            return fail("expected a number");
+        char* number_end;
+        errno = 0;
+        value = std::strtoull(text.c_str(), &number_end, 10);
+        if (!std::isdigit((unsigned char)text[0]) || *number_end || errno == ERANGE)
+            return fail("expected a whole number from 0 to 2^64-1, got '" + text + "'");
+        return true;
+    }
+
+    bool vector(vec3& v) {
+        double x, y, z;
+        if (!number(x) || !number(y) || !number(z))
+            return false;
+        v = vec3(x, y, z);
+        return true;
+    }
+
+    bool next_is_number() {
+        return !at_line_end() && (std::isdigit((unsigned char)*p) || *p == '-' || *p == '+'
+                                  || *p == '.');
+    }
+
+    template <typename Map>
+    bool lookup(const Map& map, const char* kind, typename Map::mapped_type& value) {
+        auto name = word();
+        if (name.empty())
+            return fail(std::string("expected a ") + kind + " name");
+        auto it = map.find(std::string(name));
+        if (it == map.end())
+            return fail(std::string("unknown ") + kind + " '" + std::string(name) + "'");
+        value = it->second;
+        return true;
+    }
+
+    template <typename Map>
+    bool define(const Map& map, const char* kind, const std::string& name) {
+        // Checks that a statement defining a name gives one not already in use.
+        if (name.empty())
+            return fail(std::string("expected a ") + kind + " name");
+        if (map.count(name))
+            return fail(std::string(kind) + " '" + name + "' is already defined");
+        return true;
+    }
+
+    std::filesystem::path resolve(std::string_view name) const {
+        // Relative file names are relative to the scene file.
+        std::filesystem::path file{ std::string(name) };
+        if (file.is_relative())
+            file = std::filesystem::path(source).parent_path() / file;
+        return file;
+    }
+
+    bool color_or_texture(texture_entry& entry) {
+        // Either a texture name or an inline r g b color.
+        if (!next_is_number())
+            return lookup(textures, "texture", entry);
+        if (!vector(entry.value))
+            return false;
+        entry.tex = make_shared<solid_color>(entry.value);
+        entry.solid = true;
+        return true;
+    }
+
+    void cannot_cache(const char* reason) {
+        if (uncacheable.empty())
+            uncacheable = reason;
+    }
+
+    void cache(const material_entry& entry, const cached_primitive& prim) {
+        // Records a top-level primitive for the scene cache.
+        if (!record_cache || target != &primitives)
+            return;
+        if (entry.cache_index == no_cache_index)
+            cannot_cache("it has textured materials");
+        else
+            cache_primitives.push_back(prim);
+    }
+
+    // Statements
+
+    bool statement() {
+        auto keyword = word();
+        if (keyword == "sphere")   return parse_sphere();
+        if (keyword == "quad")     return parse_quad();
+        if (keyword == "box")      return parse_box();
+        if (keyword == "mesh")     return parse_mesh();
+        if (keyword == "material") return parse_material();
+        if (keyword == "texture")  return parse_texture();
+        if (keyword == "camera")   return parse_camera();
+        if (keyword == "light")    return parse_light();
+        if (keyword == "object")   return parse_object();
+        if (keyword == "end")      return parse_end();
+        if (keyword == "instance") return parse_instance();
+        if (keyword == "accel")    return parse_accel();
+        return fail("unknown statement '" + std::string(keyword) + "'");
+    }
+
+    void add(shared_ptr<hittable> object, size_t count = 1) {
+        target->add(std::move(object));
+        primitive_count += count;
+    }
+
+    bool parse_sphere() {
+        material_entry entry;
+        point3 center;
+        double radius;
+        if (!lookup(materials, "material", entry) || !vector(center) || !number(radius))
+            return false;
+
+        if (!at_line_end()) {
+            if (word() != "to")
+                return fail("expected 'to' or the end of the line");
+            point3 center2;
+            if (!vector(center2))
+                return false;
+            add(make_shared<sphere>(center, center2, radius, entry.mat));
+            cache(entry, cached_primitive::make_sphere(center, center2, radius, entry.cache_index));
+            return true;
+        }
+
+        if (target == &group) {
+            group_spheres.push_back({ center, radius, entry.mat });
+            primitive_count++;
+            return true;
+        }
+        add(make_shared<sphere>(center, radius, entry.mat));
+        cache(entry, cached_primitive::make_sphere(center, center, radius, entry.cache_index));
+        return true;
+    }
+
+    bool parse_quad() {
+        material_entry entry;
+        point3 Q;
+        vec3 u, v;
+        if (!lookup(materials, "material", entry) || !vector(Q) || !vector(u) || !vector(v))
+            return false;
+        add(make_shared<quad>(Q, u, v, entry.mat));
+        cache(entry, cached_primitive::make_quad(Q, u, v, entry.cache_index));
+        return true;
+    }
+
+    bool parse_box() {
+        material_entry entry;
+        point3 a, b;
+        if (!lookup(materials, "material", entry) || !vector(a) || !vector(b))
+            return false;
+        add(box(a, b, entry.mat), 6);
+        box_sides(a, b, [&](const point3& Q, const vec3& u, const vec3& v) {
+            cache(entry, cached_primitive::make_quad(Q, u, v, entry.cache_index));
+        });
+        return true;
+    }
+
+    bool parse_mesh() {
+        material_entry entry;
+        if (!lookup(materials, "material", entry))
+            return false;
+        auto name = word();
+        if (name.empty())
+            return fail("expected a mesh file name");
+        auto file = resolve(name);
+
+        triangle_mesh_data data;
+        if (!load_mesh(file.string(), data))
+            return fail("could not load mesh '" + file.string() + "'");
+        auto mesh = make_shared<triangle_mesh>(std::move(data), entry.mat);
+        add(mesh, mesh->triangle_count());
+        if (target == &primitives)
+            cannot_cache("it has meshes");
+        return true;
+    }
+
+    bool parse_light() {
+        // Shapes sampled directly by the light PDF; they carry no material.
+        auto shape = word();
+        if (shape == "sphere") {
+            point3 center;
+            double radius;
+            if (!vector(center) || !number(radius))
+                return false;
+            out->lights.add(make_shared<sphere>(center, radius, shared_ptr<material>()));
+            cache_lights.push_back(cached_primitive::make_sphere(center, center, radius, 0));
+            return true;
+        }
+        if (shape == "quad") {
+            point3 Q;
+            vec3 u, v;
+            if (!vector(Q) || !vector(u) || !vector(v))
+                return false;
+            out->lights.add(make_shared<quad>(Q, u, v, shared_ptr<material>()));
+            cache_lights.push_back(cached_primitive::make_quad(Q, u, v, 0));
+            return true;
+        }
+        return fail("light must be a sphere or a quad");
+    }
+
+    bool parse_texture() {
+        std::string name(word());
+        if (!define(textures, "texture", name))
+            return false;
+        auto kind = word();
+        texture_entry entry;
+
+        if (kind == "solid") {
+            if (!vector(entry.value))
+                return false;
+            entry.tex = make_shared<solid_color>(entry.value);
+            entry.solid = true;
+        } else if (kind == "checker") {
+            double scale;
+            texture_entry even, odd;
+            if (!number(scale) || !color_or_texture(even) || !color_or_texture(odd))
+                return false;
+            entry.tex = make_shared<checker_texture>(scale, even.tex, odd.tex);
+        } else if (kind == "image") {
+            // Not found next to the scene file, the name is left to rtw_image's own search
+            // (RTW_IMAGES, then images/ directories).
+            auto name = word();
+            if (name.empty())
+                return fail("expected an image file name");
+            auto file = resolve(name);
+            std::error_code error;
+            auto filename = std::filesystem::exists(file, error) ? file.string()
+                                                                 : std::string(name);
+            entry.tex = make_shared<image_texture>(filename.c_str());
+        } else if (kind == "noise") {
+            double scale;
+            if (!number(scale))
+                return false;
+            entry.tex = make_shared<noise_texture>(scale);
+        } else {
+            return fail("unknown texture type '" + std::string(kind) + "'");
+        }
+
+        textures[name] = entry;
+        return true;
+    }
+
+    bool parse_material() {
+        std::string name(word());
+        if (!define(materials, "material", name))
+            return false;
+        auto kind = word();
+        shared_ptr<material> mat;
+        texture_entry tex;
+        cached_material record = {};
+
+        if (kind == "lambertian") {
+            if (!color_or_texture(tex))
+                return false;
+            mat = make_shared<lambertian>(tex.tex);
+            record.kind = uint32_t(cached_material_kind::lambertian);
+        } else if (kind == "metal") {
+            double fuzz;
+            if (!vector(tex.value) || !number(fuzz))
+                return false;
+            mat = make_shared<metal>(tex.value, fuzz);
+            tex.solid = true;
+            record.kind = uint32_t(cached_material_kind::metal);
+            record.param = fuzz;
+        } else if (kind == "dielectric") {
+            double ior;
+            if (!number(ior))
+                return false;
+            mat = make_shared<dielectric>(ior);
+            tex.solid = true;
+            record.kind = uint32_t(cached_material_kind::dielectric);
+            record.param = ior;
+        } else if (kind == "light") {
+            if (!color_or_texture(tex))
+                return false;
+            mat = make_shared<diffuse_light>(tex.tex);
+            record.kind = uint32_t(cached_material_kind::light);
+        } else if (kind == "isotropic") {
+            if (!color_or_texture(tex))
+                return false;
+            mat = make_shared<isotropic>(tex.tex);
+            record.kind = uint32_t(cached_material_kind::isotropic);
+        } else {
+            return fail("unknown material type '" + std::string(kind) + "'");
+        }
+
+        auto cache_index = no_cache_index;
+        if (record_cache && tex.solid) {
+            cached_primitive::store(record.albedo, tex.value);
+            cache_index = uint32_t(cache_materials.size());
+            cache_materials.push_back(record);
+        }
+
+        materials[name] = material_entry{ mat, cache_index };
+        return true;
+    }
+
+    bool parse_camera() {
+        camera& cam = out->cam;
+        while (!at_line_end()) {
+            auto key = word();
+            bool ok;
+            if (key == "aspect")          ok = number(cam.aspect_ratio);
+            else if (key == "width")      ok = count(cam.image_width);
+            else if (key == "spp")        ok = count(cam.samples_per_pixel);
+            else if (key == "depth")      ok = count(cam.max_depth);
+            else if (key == "background") ok = vector(cam.background);
+            else if (key == "vfov")       ok = number(cam.vfov);
+            else if (key == "lookfrom")   ok = vector(cam.lookfrom);
+            else if (key == "lookat")     ok = vector(cam.lookat);
+            else if (key == "vup")        ok = vector(cam.vup);
+            else if (key == "defocus")    ok = number(cam.defocus_angle);
+            else if (key == "focus")      ok = number(cam.focus_dist);
+            else if (key == "seed")       ok = number(cam.seed);
+            else {
+                return fail("unknown camera setting '" + std::string(key) + "'");
+            }
+            if (!ok)
+                return false;
+        }
+        return true;
+    }
+
+    bool parse_object() {
+        if (!group_name.empty())
+            return fail("objects cannot be nested");
+        auto name = std::string(word());
+        if (name.empty() || word() != "begin")
+            return fail("expected 'object NAME begin'");
+        if (!define(objects, "object", name))
+            return false;
+        group_name = name;
+        group.clear();
+        group_spheres.clear();
+        target = &group;
+        return true;
+    }
+
+    bool parse_end() {
+        if (group_name.empty())
+            return fail("'end' without 'object'");
+
+        // Particle-like groups keep their static spheres in one sphere_set.
+        if (group_spheres.size() >= min_sphere_set_size) {
+            auto set = make_shared<sphere_set>();
+            for (const auto& s : group_spheres)
+                set->add(s.center, s.radius, s.mat);
+            set->build();
+            group.add(set);
+        } else {
+            for (const auto& s : group_spheres)
+                group.add(make_shared<sphere>(s.center, s.radius, s.mat));
+        }
+        group_spheres.clear();
+
+        // Large groups get their own BVH, so every instance shares it.
+        shared_ptr<hittable> object;
+        if (group.objects.size() > 8)
+            object = make_shared<linear_bvh>(group, bvh_options);
+        else
+            object = make_shared<hittable_list>(group);
+
+        objects[group_name] = object;
+        group_name.clear();
+        target = &primitives;
+        return true;
+    }
+
+    bool parse_instance() {
+        // Transforms apply in the order written and are fused into one matrix. A top-level
+        // instance without a medium goes into the instance_tlas; otherwise the matrix becomes
+        // a transform, with a medium wrapping whatever precedes it.
+        shared_ptr<hittable> geometry;
+        if (!lookup(objects, "object", geometry))
+            return false;
+        shared_ptr<hittable> object = geometry;
+        auto placement = affine::identity();
+        bool transformed = false, has_medium = false;
+
+        auto place = [&]() {
+            if (!placement.invertible())
+                return fail("instance transform is not invertible");
+            if (transformed)
+                object = make_shared<transform>(object, placement);
+            placement = affine::identity();
+            transformed = false;
+            return true;
+        };
+
+        while (!at_line_end()) {
+            auto op = word();
+            if (op == "translate") {
+                vec3 offset;
+                if (!vector(offset))
+                    return false;
+                placement = affine::translation(offset) * placement;
+            } else if (op == "rotate_y") {
+                double angle;
+                if (!number(angle))
+                    return false;
+                placement = affine::rotation(vec3(0, 1, 0), angle) * placement;
+            } else if (op == "rotate") {
+                vec3 axis;
+                double angle;
+                if (!vector(axis) || !number(angle))
+                    return false;
+                if (axis.length_squared() == 0)
+                    return fail("rotation axis must not be zero");
+                placement = affine::rotation(axis, angle) * placement;
+            } else if (op == "scale") {
+                vec3 factors;
+                if (!vector(factors))
+                    return false;
+                placement = affine::scaling(factors) * placement;
+            } else if (op == "medium") {
+                double density;
+                texture_entry tex;
+                if (!number(density) || !color_or_texture(tex) || !place())
+                    return false;
+                object = make_shared<constant_medium>(object, density, tex.tex);
+                has_medium = true;
+                continue;
+            } else {
+                return fail("unknown instance operation '" + std::string(op) + "'");
+            }
+            transformed = true;
+        }
+
+        if (target == &primitives && !has_medium) {
+            if (!placement.invertible())
+                return fail("instance transform is not invertible");
+            instances->add(geometry, placement);
+        } else {
+            if (!place())
+                return false;
+            add(object, 0);
+        }
+        if (target == &primitives)
+            cannot_cache("it has instances");
+        return true;
+    }
+
+    bool parse_accel() {
+        auto kind = word();
+        if (kind == "none") {
+            use_bvh = false;
+            cannot_cache("it uses accel none");
+        } else if (kind == "median") {
+            use_bvh = true;
+            bvh_width = 2;
+            bvh_options.method = bvh_split_method::median;
+        } else if (kind == "sah") {
+            use_bvh = true;
+            bvh_width = 2;
+            bvh_options.method = bvh_split_method::sah;
+        } else if (kind == "bvh4" || kind == "bvh8") {
+            use_bvh = true;
+            bvh_width = kind == "bvh4" ? 4 : 8;
+            bvh_options.method = bvh_split_method::sah;
+            cannot_cache("it uses a wide BVH");
+        } else {
+            return fail("unknown accel '" + std::string(kind) + "'");
+        }
+        return true;
+    }
+};
+
+inline bool load_scene_cache(const std::string& cache_path, uint64_t source_size,
+                             int64_t source_time, scene_description& scene) {
+    scene_cache_header header;
+    shared_ptr<hittable> world;
+    if (!scene_cache::load(cache_path, source_size, source_time, header, world, scene.lights))
+        return false;
+
+    scene.world.clear();
+    scene.world.add(world);
+    header.camera_settings.apply(scene.cam);
+    scene.primitive_count = size_t(header.primitive_count);
+    scene.from_cache = true;
+    return true;
+}
+
+inline bool load_scene(const std::string& path, scene_description& scene,
+                       const std::string& cache_path = "") {
+    // Loads a scene file, or its cache when cache_path names an up-to-date one.
+    auto start = std::chrono::steady_clock::now();
+    auto seconds_since_start = [&] {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    uint64_t source_size = 0;
+    int64_t source_time = 0;
+    bool use_cache = !cache_path.empty() && scene_source_stamp(path, source_size, source_time);
+    if (use_cache && load_scene_cache(cache_path, source_size, source_time, scene)) {
+        scene.parse_seconds = seconds_since_start();
+        std::clog << "Loaded " << path << " from " << cache_path << ": " << scene.primitive_count
+                  << " primitives in " << scene.parse_seconds << " s\n";
+        return true;
+    }
+
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::cerr << "ERROR: Could not open scene file '" << path << "'.\n";
+        return false;
+    }
+    in.seekg(0, std::ios::end);
+    std::string text(size_t(in.tellg()), '\0');
+    in.seekg(0, std::ios::beg);
+    in.read(&text[0], std::streamsize(text.size()));
+
+    scene_parser parser(text, path, use_cache);
+    if (!parser.parse(scene))
+        return false;
+    scene.parse_seconds = seconds_since_start();
+
+    // Render from the cache just written, if there is one, so that this render and every
+    // later one trace exactly the same data.
+    bool cached = use_cache && parser.save_cache(cache_path, scene, source_size, source_time)
+               && load_scene_cache(cache_path, source_size, source_time, scene);
+    if (cached)
+        scene.build_seconds = seconds_since_start() - scene.parse_seconds;
+    else
+        parser.build_world(scene);
+
+    std::clog << "Loaded " << path << ": " << scene.primitive_count << " primitives, parsed in "
+              << scene.parse_seconds << " s, " << (cached ? "cache written" : "BVH built")
+              << " in " << scene.build_seconds << " s\n";
+    return true;
+}
+
+#endif //SCENE_LOADER_H
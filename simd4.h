@@ -0,0 +1,182 @@
+#ifndef SIMD4_H
+#define SIMD4_H
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// Four lanes of float or double in one register (two for double without AVX2), holding
+// an x, y, z vector and a padding lane. This is the storage and arithmetic behind
+// basic_vec3: SSE or NEON for float, AVX2, SSE2 or NEON for double, and plain arrays
+// everywhere else. Every operation is lane by lane except sum3, which adds x + y + z in
+// that order, so results are bit-for-bit those of the scalar code.
+
+template <typename T>
+struct simd4 {
+    T v[4];
+
+    static simd4 load(const T* p) { return {{ p[0], p[1], p[2], p[3] }}; }
+    static simd4 set(T x, T y, T z, T w) { return {{ x, y, z, w }}; }
+    void store(T* p) const { for (int k = 0; k < 4; k++) p[k] = v[k]; }
+
+    friend simd4 operator+(simd4 a, simd4 b) {
+        return {{ a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3] }};
+    }
+    friend simd4 operator-(simd4 a, simd4 b) {
+        return {{ a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3] }};
+    }
+    friend simd4 operator*(simd4 a, simd4 b) {
+        return {{ a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3] }};
+    }
+
+    simd4 yzx() const { return {{ v[1], v[2], v[0], v[3] }}; }
+    simd4 zxy() const { return {{ v[2], v[0], v[1], v[3] }}; }
+    T sum3() const { return v[0] + v[1] + v[2]; }
+};
+
+#if defined(__SSE2__) || defined(_M_X64)
+
+template <>
+struct simd4<float> {
+    __m128 v;
+
+    static simd4 load(const float* p) { return { _mm_load_ps(p) }; }
+    static simd4 set(float x, float y, float z, float w) { return { _mm_setr_ps(x, y, z, w) }; }
+    void store(float* p) const { _mm_store_ps(p, v); }
+
+    friend simd4 operator+(simd4 a, simd4 b) { return { _mm_add_ps(a.v, b.v) }; }
+    friend simd4 operator-(simd4 a, simd4 b) { return { _mm_sub_ps(a.v, b.v) }; }
+    friend simd4 operator*(simd4 a, simd4 b) { return { _mm_mul_ps(a.v, b.v) }; }
+
+    simd4 yzx() const { return { _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 0, 2, 1)) }; }
+    simd4 zxy() const { return { _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 1, 0, 2)) }; }
+    float sum3() const {
+        __m128 xy = _mm_add_ss(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)));
+        return _mm_cvtss_f32(_mm_add_ss(xy, _mm_movehl_ps(v, v)));
+    }
+};
+
+#if defined(__AVX2__)
+
+template <>
+struct simd4<double> {
+    __m256d v;
+
+    static simd4 load(const double* p) { return { _mm256_load_pd(p) }; }
+    static simd4 set(double x, double y, double z, double w) {
+        return { _mm256_setr_pd(x, y, z, w) };
+    }
+    void store(double* p) const { _mm256_store_pd(p, v); }
+
+    friend simd4 operator+(simd4 a, simd4 b) { return { _mm256_add_pd(a.v, b.v) }; }
+    friend simd4 operator-(simd4 a, simd4 b) { return { _mm256_sub_pd(a.v, b.v) }; }
+    friend simd4 operator*(simd4 a, simd4 b) { return { _mm256_mul_pd(a.v, b.v) }; }
+
+    simd4 yzx() const { return { _mm256_permute4x64_pd(v, _MM_SHUFFLE(3, 0, 2, 1)) }; }
+    simd4 zxy() const { return { _mm256_permute4x64_pd(v, _MM_SHUFFLE(3, 1, 0, 2)) }; }
+    double sum3() const {
+        __m128d lo = _mm256_castpd256_pd128(v);
+        __m128d xy = _mm_add_sd(lo, _mm_unpackhi_pd(lo, lo));
+        return _mm_cvtsd_f64(_mm_add_sd(xy, _mm256_extractf128_pd(v, 1)));
+    }
+};
+
+#else
+
+template <>
+struct simd4<double> {
+    __m128d xy, zw;
+
+    static simd4 load(const double* p) { return { _mm_load_pd(p), _mm_load_pd(p + 2) }; }
+    static simd4 set(double x, double y, double z, double w) {
+        return { _mm_setr_pd(x, y), _mm_setr_pd(z, w) };
+    }
+    void store(double* p) const { _mm_store_pd(p, xy); _mm_store_pd(p + 2, zw); }
+
+    friend simd4 operator+(simd4 a, simd4 b) {
+        return { _mm_add_pd(a.xy, b.xy), _mm_add_pd(a.zw, b.zw) };
+    }
+    friend simd4 operator-(simd4 a, simd4 b) {
+        return { _mm_sub_pd(a.xy, b.xy), _mm_sub_pd(a.zw, b.zw) };
+    }
+    friend simd4 operator*(simd4 a, simd4 b) {
+        return { _mm_mul_pd(a.xy, b.xy), _mm_mul_pd(a.zw, b.zw) };
+    }
+
+    simd4 yzx() const { return { _mm_shuffle_pd(xy, zw, 1), _mm_shuffle_pd(xy, zw, 2) }; }
+    simd4 zxy() const { return { _mm_shuffle_pd(zw, xy, 0), _mm_shuffle_pd(xy, zw, 3) }; }
+    double sum3() const {
+        return _mm_cvtsd_f64(_mm_add_sd(_mm_add_sd(xy, _mm_unpackhi_pd(xy, xy)), zw));
+    }
+};
+
+#endif
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+
+template <>
+struct simd4<float> {
+    float32x4_t v;
+
+    static simd4 load(const float* p) { return { vld1q_f32(p) }; }
+    static simd4 set(float x, float y, float z, float w) {
+        const float lanes[4] = { x, y, z, w };
+        return { vld1q_f32(lanes) };
+    }
+    void store(float* p) const { vst1q_f32(p, v); }
+
+    friend simd4 operator+(simd4 a, simd4 b) { return { vaddq_f32(a.v, b.v) }; }
+    friend simd4 operator-(simd4 a, simd4 b) { return { vsubq_f32(a.v, b.v) }; }
+    friend simd4 operator*(simd4 a, simd4 b) { return { vmulq_f32(a.v, b.v) }; }
+
+    simd4 yzx() const {
+        return set(vgetq_lane_f32(v, 1), vgetq_lane_f32(v, 2),
+                   vgetq_lane_f32(v, 0), vgetq_lane_f32(v, 3));
+    }
+    simd4 zxy() const {
+        return set(vgetq_lane_f32(v, 2), vgetq_lane_f32(v, 0),
+                   vgetq_lane_f32(v, 1), vgetq_lane_f32(v, 3));
+    }
+    float sum3() const {
+        return vgetq_lane_f32(v, 0) + vgetq_lane_f32(v, 1) + vgetq_lane_f32(v, 2);
+    }
+};
+
+template <>
+struct simd4<double> {
+    float64x2_t xy, zw;
+
+    static simd4 load(const double* p) { return { vld1q_f64(p), vld1q_f64(p + 2) }; }
+    static simd4 set(double x, double y, double z, double w) {
+        const double lanes[4] = { x, y, z, w };
+        return load(lanes);
+    }
+    void store(double* p) const { vst1q_f64(p, xy); vst1q_f64(p + 2, zw); }
+
+    friend simd4 operator+(simd4 a, simd4 b) {
+        return { vaddq_f64(a.xy, b.xy), vaddq_f64(a.zw, b.zw) };
+    }
+    friend simd4 operator-(simd4 a, simd4 b) {
+        return { vsubq_f64(a.xy, b.xy), vsubq_f64(a.zw, b.zw) };
+    }
+    friend simd4 operator*(simd4 a, simd4 b) {
+        return { vmulq_f64(a.xy, b.xy), vmulq_f64(a.zw, b.zw) };
+    }
+
+    simd4 yzx() const {
+        return { vextq_f64(xy, zw, 1), vcombine_f64(vget_low_f64(xy), vget_high_f64(zw)) };
+    }
+    simd4 zxy() const {
+        return { vcombine_f64(vget_low_f64(zw), vget_low_f64(xy)),
+                 vcombine_f64(vget_high_f64(xy), vget_high_f64(zw)) };
+    }
+    double sum3() const {
+        return vgetq_lane_f64(xy, 0) + vgetq_lane_f64(xy, 1) + vgetq_lane_f64(zw, 0);
+    }
+};
+
+#endif
+
+#endif //SIMD4_H
@@ -27,7 +27,14 @@ public:
     }
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-        point3 current_center = center.at(r.time());
+        return hit_sphere(center.origin(), center.direction(), radius, mat.get(), r, ray_t, rec);
+    }
+
+    static bool hit_sphere(const point3& center0, const vec3& motion, real radius,
+                           const material* mat, const ray& r, interval ray_t, hit_record& rec) {
+        // The intersection itself, for callers that store spheres as plain data (see
+        // cached_scene). The center moves from center0 by motion over the shutter interval.
+        point3 current_center = center0 + r.time()*motion;
         vec3 oc = current_center - r.origin();
         auto a = r.direction().length_squared();
         auto h = dot(r.direction(), oc);
@@ -47,19 +54,79 @@ public:
                 return false;
         }
 
-        rec.t = root;
-        rec.p = r.at(rec.t);
+        set_hit_record(r, root, current_center, radius, mat, rec);
+
+        //std::cout << 'rec.p: ' << rec.p << '\ncenter: ' << center << '\nradius' << radius << '\noutward_noral' << outward_normal;
+
+        return true;
+    }
 
-        vec3 outward_normal = (rec.p - current_center) / radius;
+    static void set_hit_record(const ray& r, real t, const point3& current_center,
+                               real radius, const material* mat, hit_record& rec) {
+        // Fills rec for a hit at distance t, given the sphere's center at the ray's time.
+        // The point is projected back onto the sphere, which bounds its error by a few
+        // roundings of its coordinates however far t is off.
+        rec.t = t;
+        vec3 from_center = r.at(t) - current_center;
+        from_center *= radius / from_center.length();
+        rec.p = current_center + from_center;
+        rec.set_error_bound(from_center / radius,
+                            rounding_gamma<real>(5) * (abs(from_center) + abs(rec.p)));
+
+        vec3 outward_normal = from_center / radius;
         rec.set_face_normal(r, outward_normal);
 
         get_sphere_uv(outward_normal, rec.u, rec.v);
 
         rec.mat = mat;
+    }
 
-        //std::cout << 'rec.p: ' << rec.p << '\ncenter: ' << center << '\nradius' << radius << '\noutward_noral' << outward_normal;
+    ray_packet::lane_mask hit_packet(ray_packet& rays, ray_packet::lane_mask active,
+                                     hit_record* recs) const override {
+        // Solve the quadratic for every lane at once, then fill records for the lanes hit.
+        constexpr int n = ray_packet::size;
+        alignas(64) double t_hit[n];
+
+        const point3 c0 = center.origin();
+        const vec3 motion = center.direction();
+        const double r2 = radius * radius;
+
+        #pragma omp simd
+        for (int lane = 0; lane < n; lane++) {
+            auto ocx = c0.x() + rays.tm[lane]*motion.x() - rays.ox[lane];
+            auto ocy = c0.y() + rays.tm[lane]*motion.y() - rays.oy[lane];
+            auto ocz = c0.z() + rays.tm[lane]*motion.z() - rays.oz[lane];
+
+            auto a = rays.dx[lane]*rays.dx[lane] + rays.dy[lane]*rays.dy[lane]
+                   + rays.dz[lane]*rays.dz[lane];
+            auto h = rays.dx[lane]*ocx + rays.dy[lane]*ocy + rays.dz[lane]*ocz;
+            auto c = ocx*ocx + ocy*ocy + ocz*ocz - r2;
+
+            auto discriminant = h*h - a*c;
+            auto sqrtd = std::sqrt(discriminant < 0 ? 0.0 : discriminant);
+
+            auto near_root = (h - sqrtd) / a;
+            auto far_root = (h + sqrtd) / a;
+            bool near_ok = rays.t_min[lane] < near_root && near_root < rays.t_max[lane];
+            bool far_ok = rays.t_min[lane] < far_root && far_root < rays.t_max[lane];
+
+            t_hit[lane] = discriminant < 0 ? infinity
+                        : near_ok ? near_root
+                        : far_ok ? far_root
+                        : infinity;
+        }
 
-        return true;
+        ray_packet::lane_mask hits = 0;
+        for (int lane = 0; lane < n; lane++) {
+            if (!ray_packet::has_lane(active, lane) || t_hit[lane] == infinity)
+                continue;
+
+            auto r = rays.get(lane);
+            set_hit_record(r, t_hit[lane], center.at(r.time()), radius, mat.get(), recs[lane]);
+            rays.t_max[lane] = t_hit[lane];
+            hits |= ray_packet::lane_mask(1) << lane;
+        }
+        return hits;
     }
 
     aabb bounding_box() const override { return bbox; };
@@ -67,7 +134,7 @@ public:
     // This only works for stationary spheres
     double pdf_value(const point3& origin, const vec3& direction) const override {
         hit_record rec;
-        if(!this->hit(ray(origin, direction), interval(0.001, infinity), rec))
+        if(!this->hit(ray(origin, direction), interval(0, infinity), rec))
             return 0;
 
         auto dist_squared = (center.at(0) - origin).length_squared();
@@ -86,11 +153,11 @@ public:
 
 private:
     ray center;
-    double radius;
+    real radius;
     shared_ptr<material> mat;
     aabb bbox;
 
-    static void get_sphere_uv(const point3& p, double& u, double& v) {
+    static void get_sphere_uv(const point3& p, real& u, real& v) {
         // p: given point on the unit sphere
         // u: returned val [0,1] of angle around Y axis (2pi)
         // v: returned val [0,1] of angle from y=-1 to y=1 (pi)
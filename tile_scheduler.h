@@ -0,0 +1,166 @@
+#ifndef TILE_SCHEDULER_H
+#define TILE_SCHEDULER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Splits the image into square tiles and hands them out to render threads. Tiles are
+// ordered along a space-filling curve and each thread starts on its own contiguous run of
+// that order, so consecutive tiles on a thread are neighbours in the image and share BVH
+// nodes and texels in cache. A thread that runs dry steals from the far end of another
+// thread's run, which balances hot spots such as a Cornell box light.
+
+struct tile {
+    int x0, y0;     // Top-left pixel, inclusive
+    int x1, y1;     // Bottom-right pixel, exclusive
+};
+
+enum class tile_order {
+    scanline,   // Row by row
+    morton,     // Z-order curve
+    hilbert     // Hilbert curve; neighbouring tiles are always adjacent
+};
+
+inline uint32_t morton_index(uint32_t x, uint32_t y) {
+    auto spread = [](uint32_t v) {
+        v &= 0xffff;
+        v = (v | (v << 8)) & 0x00ff00ff;
+        v = (v | (v << 4)) & 0x0f0f0f0f;
+        v = (v | (v << 2)) & 0x33333333;
+        v = (v | (v << 1)) & 0x55555555;
+        return v;
+    };
+    return spread(x) | (spread(y) << 1);
+}
+
+inline uint32_t hilbert_index(uint32_t n, uint32_t x, uint32_t y) {
+    // Distance along the Hilbert curve filling an n x n grid, n a power of two.
+    uint32_t d = 0;
+    for (uint32_t s = n / 2; s > 0; s /= 2) {
+        uint32_t rx = (x & s) > 0;
+        uint32_t ry = (y & s) > 0;
+        d += s * s * ((3 * rx) ^ ry);
+
+        // Rotate the quadrant so the curve inside it has the canonical orientation.
+        if (ry == 0) {
+            if (rx == 1) {
+                x = s - 1 - x;
+                y = s - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
+
+inline std::vector<tile> make_tiles(int width, int height, int tile_size, tile_order order) {
+    tile_size = std::max(tile_size, 1);
+    int tiles_x = (width + tile_size - 1) / tile_size;
+    int tiles_y = (height + tile_size - 1) / tile_size;
+
+    uint32_t grid = 1;
+    while (grid < uint32_t(std::max(tiles_x, tiles_y)))
+        grid *= 2;
+
+    struct keyed_tile {
+        uint32_t key;
+        tile t;
+    };
+
+    std::vector<keyed_tile> keyed;
+    keyed.reserve(size_t(tiles_x) * tiles_y);
+    for (int ty = 0; ty < tiles_y; ty++) {
+        for (int tx = 0; tx < tiles_x; tx++) {
+            uint32_t key = (order == tile_order::morton)  ? morton_index(tx, ty)
+                         : (order == tile_order::hilbert) ? hilbert_index(grid, tx, ty)
+                                                          : uint32_t(ty * tiles_x + tx);
+            tile t = { tx * tile_size, ty * tile_size,
+                       std::min((tx + 1) * tile_size, width),
+                       std::min((ty + 1) * tile_size, height) };
+            keyed.push_back({ key, t });
+        }
+    }
+
+    std::sort(keyed.begin(), keyed.end(),
+              [](const keyed_tile& a, const keyed_tile& b) { return a.key < b.key; });
+
+    std::vector<tile> tiles;
+    tiles.reserve(keyed.size());
+    for (const auto& k : keyed)
+        tiles.push_back(k.t);
+    return tiles;
+}
+
+class tile_scheduler {
+  public:
+    tile_scheduler(int tile_count, int thread_count)
+      : queues(new queue[std::max(thread_count, 1)]), thread_count(std::max(thread_count, 1))
+    {
+        // Thread k owns the k-th contiguous slice of the tile order.
+        for (int k = 0; k < this->thread_count; k++) {
+            auto begin = uint32_t(int64_t(tile_count) * k / this->thread_count);
+            auto end = uint32_t(int64_t(tile_count) * (k + 1) / this->thread_count);
+            queues[k].range.store(pack(begin, end));
+        }
+    }
+
+    bool next(int thread, int& tile_index) {
+        // The owner takes tiles from the front of its run, in curve order.
+        if (pop_front(queues[thread], tile_index))
+            return true;
+
+        // Otherwise steal from the back of another thread's run, starting with the next
+        // thread along so thieves spread out over different victims.
+        for (int k = 1; k < thread_count; k++) {
+            if (pop_back(queues[(thread + k) % thread_count], tile_index)) {
+                steals++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int steal_count() const { return steals.load(); }
+
+  private:
+    // Each run [begin, end) is packed into one 64-bit word, so the owner and thieves
+    // claim tiles with a single compare-and-swap and never take a lock.
+    struct alignas(64) queue {
+        std::atomic<uint64_t> range{0};
+    };
+
+    std::unique_ptr<queue[]> queues;
+    int thread_count;
+    std::atomic<int> steals{0};
+
+    static uint64_t pack(uint32_t begin, uint32_t end) { return (uint64_t(end) << 32) | begin; }
+    static uint32_t begin_of(uint64_t r) { return uint32_t(r); }
+    static uint32_t end_of(uint64_t r) { return uint32_t(r >> 32); }
+
+    static bool pop_front(queue& q, int& tile_index) {
+        auto r = q.range.load();
+        while (begin_of(r) < end_of(r)) {
+            if (q.range.compare_exchange_weak(r, pack(begin_of(r) + 1, end_of(r)))) {
+                tile_index = int(begin_of(r));
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static bool pop_back(queue& q, int& tile_index) {
+        auto r = q.range.load();
+        while (begin_of(r) < end_of(r)) {
+            if (q.range.compare_exchange_weak(r, pack(begin_of(r), end_of(r) - 1))) {
+                tile_index = int(end_of(r) - 1);
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+#endif //TILE_SCHEDULER_H
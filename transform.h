@@ -0,0 +1,92 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include "affine.h"
+#include "hittable.h"
+#include "hittable_list.h"
+
+// Places an object with an arbitrary affine transform: any mix of translations, rotations
+// about any axis and scales, applied in one step. Wrapping a transform in another fuses the
+// two matrices, so a chain built one operation at a time still costs a single ray
+// transform and a single virtual call per hit, unlike nested translate and rotate_y.
+
+class transform : public hittable {
+  public:
+    transform(shared_ptr<hittable> object, const affine& object_to_world)
+      : object(object), object_to_world(object_to_world)
+    {
+        if (auto inner = std::dynamic_pointer_cast<transform>(object)) {
+            this->object = inner->object;
+            this->object_to_world = object_to_world * inner->object_to_world;
+        }
+        world_to_object = this->object_to_world.inverse();
+        bbox = transformed_bounds(*this->object, this->object_to_world);
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        if (!hit_object(*object, world_to_object, r, ray_t, rec))
+            return false;
+        to_world(object_to_world, world_to_object, rec);
+        return true;
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    const affine& matrix() const { return object_to_world; }
+
+    static bool hit_object(const hittable& object, const affine& world_to_object, const ray& r,
+                           const interval& ray_t, hit_record& rec) {
+        // Intersects object with r carried into object space by world_to_object, leaving
+        // rec in object space for to_world. The direction is not renormalized, so hit
+        // distances agree in both spaces.
+        ray object_r(world_to_object.point(r.origin()), world_to_object.vector(r.direction()),
+                     r.time());
+        return object.hit(object_r, ray_t, rec);
+    }
+
+    static void to_world(const affine& object_to_world, const affine& world_to_object,
+                         hit_record& rec) {
+        // Moves a hit record from object space to world space. The transpose of
+        // world_to_object is the normal matrix. It keeps the normal's dot product with the
+        // ray direction, so a normal facing the object-space ray still faces the world ray.
+        const point3 object_p = rec.p;
+        rec.p = object_to_world.point(object_p);
+        rec.normal = unit_vector(world_to_object.transpose_vector(rec.normal));
+
+        auto distance = rec.error_offset.length();
+        if (distance == 0)
+            return;
+
+        // A distance d from the object's surface is d / |N n| from the world surface, for
+        // the normal matrix N and unit object normal n. The bound also takes in the
+        // rounding of the transform and, counted twice since world_to_object is only the
+        // rounded inverse, that of carrying a spawned origin back into object space.
+        const vec3 object_n = rec.error_offset / distance;
+        const vec3 world_n = world_to_object.transpose_vector(object_n);
+        const auto scale = world_n.length();
+        const auto object_distance = distance
+            + 2 * dot(abs(object_n), world_to_object.point_error(rec.p));
+        rec.error_offset = (world_n / scale) * (object_distance / scale);
+        rec.widen_error_bound(object_to_world.point_error(object_p));
+    }
+
+    static aabb transformed_bounds(const hittable& object, const affine& m) {
+        // Lists are bounded child by child, which is much tighter than transforming the
+        // list's own box when it is rotated: a rotated box() is bounded by its six sides.
+        if (auto list = dynamic_cast<const hittable_list*>(&object)) {
+            aabb box = aabb::empty;
+            for (const auto& child : list->objects)
+                box = aabb(box, transformed_bounds(*child, m));
+            return box;
+        }
+        return m.box(object.bounding_box());
+    }
+
+  private:
+    shared_ptr<hittable> object;
+    affine object_to_world;
+    affine world_to_object;
+    aabb bbox;
+};
+
+#endif //TRANSFORM_H
@@ -0,0 +1,262 @@
+#ifndef TRIANGLE_MESH_H
+#define TRIANGLE_MESH_H
+
+#include "hittable.h"
+#include "linear_bvh.h"
+
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// An indexed triangle mesh. Vertex attributes live in shared flat arrays of floats and
+// each triangle is three indices into them, so a triangle costs 12 bytes of indices plus
+// its share of the vertices and BVH, instead of a heap object. The mesh carries its own
+// linear BVH with single triangles as leaf primitives; the index buffer is reordered into
+// leaf order so leaves address their triangles directly.
+
+struct triangle_mesh_data {
+    std::vector<float> positions;   // x, y, z per vertex
+    std::vector<float> normals;     // x, y, z per vertex, or empty for flat shading
+    std::vector<float> uvs;         // u, v per vertex, or empty
+    std::vector<uint32_t> indices;  // Three vertex indices per triangle, counterclockwise
+
+    size_t vertex_count() const { return positions.size() / 3; }
+    size_t triangle_count() const { return indices.size() / 3; }
+
+    void add_vertex(const point3& p) {
+        positions.push_back(float(p.x()));
+        positions.push_back(float(p.y()));
+        positions.push_back(float(p.z()));
+    }
+
+    void add_triangle(uint32_t a, uint32_t b, uint32_t c) {
+        indices.push_back(a);
+        indices.push_back(b);
+        indices.push_back(c);
+    }
+};
+
+class triangle_mesh : public hittable {
+  public:
+    triangle_mesh(triangle_mesh_data data, shared_ptr<material> mat,
+                  const bvh_build_options& options = sah_options())
+      : mesh(std::move(data)), mat(mat)
+    {
+        // Meshes that index missing vertices or have per-vertex arrays of the wrong size
+        // are cut down to what is consistent: bad triangles and attributes are dropped, as
+        // are triangles with no area, which no ray can hit.
+        const auto vertices = mesh.vertex_count();
+        if (mesh.normals.size() != 3 * vertices)
+            mesh.normals.clear();
+        if (mesh.uvs.size() != 2 * vertices)
+            mesh.uvs.clear();
+
+        size_t kept = 0;
+        for (size_t k = 0; k + 2 < mesh.indices.size(); k += 3) {
+            const uint32_t a = mesh.indices[k], b = mesh.indices[k+1], c = mesh.indices[k+2];
+            if (a >= vertices || b >= vertices || c >= vertices)
+                continue;
+            auto p0 = vertex(a);
+            if (cross(vertex(b) - p0, vertex(c) - p0).length_squared() == 0)
+                continue;
+            mesh.indices[kept++] = a;
+            mesh.indices[kept++] = b;
+            mesh.indices[kept++] = c;
+        }
+        mesh.indices.resize(kept);
+        mesh.indices.shrink_to_fit();
+
+        build(options);
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        if (nodes.empty())
+            return false;
+
+        const sheared_ray sheared(r);
+        return traverse_linear_bvh(nodes.data(), r, ray_t,
+            [&](uint32_t first, uint32_t count, interval& t) {
+                bool hit_leaf = false;
+                for (uint32_t i = first; i < first + count; i++) {
+                    if (hit_triangle(i, r, sheared, t, rec)) {
+                        hit_leaf = true;
+                        t.max = rec.t;
+                    }
+                }
+                return hit_leaf;
+            });
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    size_t triangle_count() const { return mesh.triangle_count(); }
+    size_t vertex_count() const { return mesh.vertex_count(); }
+
+    size_t memory_bytes() const {
+        // Heap memory held by the mesh and its BVH.
+        return mesh.positions.capacity() * sizeof(float) + mesh.normals.capacity() * sizeof(float)
+             + mesh.uvs.capacity() * sizeof(float) + mesh.indices.capacity() * sizeof(uint32_t)
+             + nodes.capacity() * sizeof(linear_bvh_node);
+    }
+
+    static bvh_build_options sah_options() {
+        bvh_build_options options;
+        options.method = bvh_split_method::sah;
+        return options;
+    }
+
+  private:
+    triangle_mesh_data mesh;
+    shared_ptr<material> mat;
+    std::vector<linear_bvh_node> nodes;
+    aabb bbox = aabb::empty;
+
+    point3 vertex(uint32_t index) const {
+        const float* p = &mesh.positions[3 * size_t(index)];
+        return point3(p[0], p[1], p[2]);
+    }
+
+    void build(const bvh_build_options& options) {
+        const size_t count = mesh.triangle_count();
+        std::vector<aabb> bounds;
+        bounds.reserve(count);
+        for (size_t k = 0; k < count; k++) {
+            const uint32_t* tri = &mesh.indices[3 * k];
+            auto box = aabb(aabb(vertex(tri[0]), vertex(tri[1])), aabb(vertex(tri[2]), vertex(tri[2])));
+            bounds.push_back(box);
+            bbox = aabb(bbox, box);
+        }
+
+        std::vector<uint32_t> order;
+        bvh_builder::build(bounds, options, nodes, order);
+        std::vector<aabb>().swap(bounds);
+
+        // Rewrite the index buffer in leaf order.
+        std::vector<uint32_t> ordered(mesh.indices.size());
+        for (size_t k = 0; k < order.size(); k++)
+            for (int c = 0; c < 3; c++)
+                ordered[3*k + c] = mesh.indices[3 * size_t(order[k]) + c];
+        mesh.indices.swap(ordered);
+        nodes.shrink_to_fit();
+    }
+
+    // A ray set up for the watertight test of Woop, Benthin and Wald (JCGT 2013): the axis
+    // the direction is largest along becomes z, and a shear and scale map the ray onto the
+    // +z axis from the origin, so each triangle is tested in 2D against the point (0, 0).
+    struct sheared_ray {
+        int kx, ky, kz;
+        real sx, sy, sz;
+
+        explicit sheared_ray(const ray& r) {
+            const vec3& d = r.direction();
+            const vec3 a = abs(d);
+            kz = a.x() > a.y() ? (a.x() > a.z() ? 0 : 2) : (a.y() > a.z() ? 1 : 2);
+            kx = (kz + 1) % 3;
+            ky = (kx + 1) % 3;
+            if (d[kz] < 0)
+                std::swap(kx, ky);  // Keep the triangles' winding
+            sx = d[kx] / d[kz];
+            sy = d[ky] / d[kz];
+            sz = 1 / d[kz];
+        }
+    };
+
+    template <typename T>
+    static T edge_function(T px, T py, T qx, T qy) {
+        // Twice the signed area of (0, 0), p, q. The products are always taken in the
+        // same order of the two points, so the triangles either side of an edge get
+        // exactly opposite values however the compiler fuses the multiply and subtract.
+        if (px < qx || (px == qx && py < qy))
+            return px * qy - py * qx;
+        return -(qx * py - qy * px);
+    }
+
+    bool hit_triangle(uint32_t index, const ray& r, const sheared_ray& sheared,
+                      const interval& ray_t, hit_record& rec) const {
+        // Watertight ray/triangle test (Woop, Benthin and Wald), in the renderer's precision
+        // from the float vertex data. The vertices, relative to the ray origin, are sheared
+        // into ray space, where the edge functions of a shared edge are computed from the
+        // same two transformed points and so agree exactly. A point on an edge therefore
+        // counts as inside both triangles that share it, and no ray slips between them.
+        // An edge function of exactly zero is recomputed in higher precision.
+        const uint32_t* tri = &mesh.indices[3 * size_t(index)];
+        const int kx = sheared.kx, ky = sheared.ky, kz = sheared.kz;
+        const vec3 a = vertex(tri[0]) - r.origin();
+        const vec3 b = vertex(tri[1]) - r.origin();
+        const vec3 c = vertex(tri[2]) - r.origin();
+
+        const real ax = a[kx] - sheared.sx * a[kz], ay = a[ky] - sheared.sy * a[kz];
+        const real bx = b[kx] - sheared.sx * b[kz], by = b[ky] - sheared.sy * b[kz];
+        const real cx = c[kx] - sheared.sx * c[kz], cy = c[ky] - sheared.sy * c[kz];
+
+        double u = edge_function(cx, cy, bx, by);
+        double v = edge_function(ax, ay, cx, cy);
+        double w = edge_function(bx, by, ax, ay);
+        if (u == 0 || v == 0 || w == 0) {
+            using wide = std::conditional_t<sizeof(real) < sizeof(double), double, long double>;
+            u = double(edge_function<wide>(cx, cy, bx, by));
+            v = double(edge_function<wide>(ax, ay, cx, cy));
+            w = double(edge_function<wide>(bx, by, ax, ay));
+        }
+        if ((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0))
+            return false;
+
+        const double det = u + v + w;
+        if (det == 0)
+            return false;   // Ray parallel to the triangle, or the triangle seen edge-on
+
+        const double inv_det = 1.0 / det;
+        const double t = (u * a[kz] + v * b[kz] + w * c[kz]) * sheared.sz * inv_det;
+        if (!ray_t.contains(t))
+            return false;
+        const double b1 = v * inv_det;
+        const double b2 = w * inv_det;
+        const point3 p0 = vertex(tri[0]);
+        const vec3 e1 = vertex(tri[1]) - p0;
+        const vec3 e2 = vertex(tri[2]) - p0;
+
+        // The point from its barycentric coordinates, within a few roundings of the
+        // triangle's plane (Pharr, Jakob and Humphreys, section 3.9.6).
+        const double b0 = 1 - b1 - b2;
+        const vec3 geometric_normal = unit_vector(cross(e1, e2));
+        const vec3 w0 = b0 * p0, w1 = b1 * vertex(tri[1]), w2 = b2 * vertex(tri[2]);
+        rec.t = t;
+        rec.p = w0 + w1 + w2;
+        rec.set_error_bound(geometric_normal,
+                            rounding_gamma<real>(7) * (abs(w0) + abs(w1) + abs(w2)));
+        rec.mat = mat.get();
+        rec.set_face_normal(r, geometric_normal);
+
+        if (!mesh.normals.empty()) {
+            // Interpolated shading normal, kept on the side of the surface the ray hit.
+            const float* n0 = &mesh.normals[3 * size_t(tri[0])];
+            const float* n1 = &mesh.normals[3 * size_t(tri[1])];
+            const float* n2 = &mesh.normals[3 * size_t(tri[2])];
+            vec3 shading(b0*n0[0] + b1*n1[0] + b2*n2[0],
+                         b0*n0[1] + b1*n1[1] + b2*n2[1],
+                         b0*n0[2] + b1*n1[2] + b2*n2[2]);
+            if (shading.length_squared() > 0) {
+                shading = unit_vector(shading);
+                if (dot(shading, rec.normal) < 0)
+                    shading = -shading;
+                rec.normal = shading;
+            }
+        }
+
+        if (!mesh.uvs.empty()) {
+            const float* t0 = &mesh.uvs[2 * size_t(tri[0])];
+            const float* t1 = &mesh.uvs[2 * size_t(tri[1])];
+            const float* t2 = &mesh.uvs[2 * size_t(tri[2])];
+            rec.u = b0*t0[0] + b1*t1[0] + b2*t2[0];
+            rec.v = b0*t0[1] + b1*t1[1] + b2*t2[1];
+        } else {
+            rec.u = b1;
+            rec.v = b2;
+        }
+
+        return true;
+    }
+};
+
+#endif //TRIANGLE_MESH_H
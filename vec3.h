@@ -5,114 +5,207 @@
 #ifndef VEC3_H
 #define VEC3_H
 
-class vec3 {
+#ifdef RT_SIMD_VEC3
+#include "simd4.h"
+#endif
+
+// A 3-vector of scalar type T. The renderer uses basic_vec3<real> through the vec3 and
+// point3 aliases; real is double, or float when built with RT_FLOAT.
+//
+// Built with RT_SIMD_VEC3, the components are padded to four and aligned, so a vector
+// loads into one SIMD register (see simd4.h) and add, multiply, dot and cross products
+// work on all three components at once; the fourth component is always zero. The results
+// are bit-for-bit those of the plain layout, but bench_vec3 finds it no faster overall,
+// so the plain three components are the default.
+
+template <typename T>
+class basic_vec3 {
     public:
-        double e[3];
+        using value_type = T;
+
+#ifdef RT_SIMD_VEC3
+        alignas(4 * sizeof(T)) T e[4];
+
+        basic_vec3() : e{0,0,0,0} {}
+        basic_vec3(T e0, T e1, T e2) : e{e0,e1,e2,0} {}
+
+        template <typename U>
+        explicit basic_vec3(const basic_vec3<U>& v) : e{T(v.e[0]), T(v.e[1]), T(v.e[2]), 0} {}
+
+        explicit basic_vec3(const simd4<T>& v) { v.store(e); }
+
+        simd4<T> lanes() const { return simd4<T>::load(e); }
+
+        static simd4<T> splat(T t) {
+            // t in the three components and zero in the padding, so that it stays zero even
+            // when t is infinite.
+            return simd4<T>::set(t, t, t, 0);
+        }
+#else
+        T e[3];
 
-        vec3() : e{0,0,0} {}
-        vec3(double e0, double e1, double e2) : e{e0,e1,e2} {}
+        basic_vec3() : e{0,0,0} {}
+        basic_vec3(T e0, T e1, T e2) : e{e0,e1,e2} {}
 
-        double x() const {return e[0]; }
-        double y() const {return e[1]; }
-        double z() const {return e[2]; }
+        template <typename U>
+        explicit basic_vec3(const basic_vec3<U>& v) : e{T(v.e[0]), T(v.e[1]), T(v.e[2])} {}
+#endif
 
-        vec3 operator-() const { return vec3(-e[0], -e[1], -e[2]); }
-        double operator[](int i) const { return e[i]; }
-        double& operator[](int i) { return e[i]; }
+        T x() const {return e[0]; }
+        T y() const {return e[1]; }
+        T z() const {return e[2]; }
 
-        vec3& operator+=(const vec3& v) {
+        basic_vec3 operator-() const { return basic_vec3(-e[0], -e[1], -e[2]); }
+        T operator[](int i) const { return e[i]; }
+        T& operator[](int i) { return e[i]; }
+
+        basic_vec3& operator+=(const basic_vec3& v) {
+#ifdef RT_SIMD_VEC3
+            (lanes() + v.lanes()).store(e);
+#else
             e[0] += v.e[0];
             e[1] += v.e[1];
             e[2] += v.e[2];
-
+#endif
             return *this;
         }
 
-        vec3& operator*=(double t) {
+        basic_vec3& operator*=(T t) {
+#ifdef RT_SIMD_VEC3
+            (lanes() * splat(t)).store(e);
+#else
             e[0] *= t;
             e[1] *= t;
             e[2] *= t;
-
+#endif
             return *this;
         }
 
-        vec3& operator/=(double t) {
+        basic_vec3& operator/=(T t) {
             return *this *= 1/t;
         }
 
-        double length() const {
+        T length() const {
             return std::sqrt(length_squared());
         }
 
-        double length_squared() const {
+        T length_squared() const {
+#ifdef RT_SIMD_VEC3
+            return (lanes() * lanes()).sum3();
+#else
             return e[0]*e[0] + e[1]*e[1] + e[2]*e[2];
+#endif
         }
 
         bool near_zero() const {
             // Return true if the vector is close to zero in all dimensions
-            auto s = 1e-8;
+            auto s = T(1e-8);
             return (std::fabs(e[0]) < s) && (std::fabs(e[1]) < s) && (std::fabs(e[2]) < s);
         }
 
-        static vec3 random() {
-            return vec3(random_double(),random_double(),random_double());
+        static basic_vec3 random() {
+            return basic_vec3(random_double(),random_double(),random_double());
         }
 
-        static vec3 random(double min, double max) {
-            return vec3(random_double(min,  max), random_double( min,  max), random_double( min,  max));
+        static basic_vec3 random(double min, double max) {
+            return basic_vec3(random_double(min,  max), random_double( min,  max), random_double( min,  max));
         }
 
 
 
 };
 
+using vec3 = basic_vec3<real>;
+
 //  point3 is just an alias for vec3, useful for geometric clarity in code
 using point3 = vec3;
 
-// Vector Utility Functions
+// Vector Utility Functions. Scalars are taken as the vector's own type (not deduced), so
+// double constants work unchanged with float vectors.
 
-inline std::ostream& operator<<(std::ostream& out, const vec3& v) {
+template <typename T>
+inline std::ostream& operator<<(std::ostream& out, const basic_vec3<T>& v) {
     return out << v.e[0] << ' ' << v.e[1] << ' ' << v.e[2];
 }
 
-inline vec3 operator+(const vec3& u, const vec3& v) {
-    return vec3(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
+template <typename T>
+inline basic_vec3<T> operator+(const basic_vec3<T>& u, const basic_vec3<T>& v) {
+#ifdef RT_SIMD_VEC3
+    return basic_vec3<T>(u.lanes() + v.lanes());
+#else
+    return basic_vec3<T>(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
+#endif
 }
 
-inline vec3 operator-(const vec3& u, const vec3& v) {
-    return vec3(u.e[0]-v.e[0], u.e[1]-v.e[1], u.e[2]-v.e[2]);
+template <typename T>
+inline basic_vec3<T> operator-(const basic_vec3<T>& u, const basic_vec3<T>& v) {
+#ifdef RT_SIMD_VEC3
+    return basic_vec3<T>(u.lanes() - v.lanes());
+#else
+    return basic_vec3<T>(u.e[0]-v.e[0], u.e[1]-v.e[1], u.e[2]-v.e[2]);
+#endif
 }
 
-inline vec3 operator*(const vec3& u, const vec3& v) {
-    return vec3(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
+template <typename T>
+inline basic_vec3<T> operator*(const basic_vec3<T>& u, const basic_vec3<T>& v) {
+#ifdef RT_SIMD_VEC3
+    return basic_vec3<T>(u.lanes() * v.lanes());
+#else
+    return basic_vec3<T>(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
+#endif
 }
 
-inline vec3 operator*(double t, const vec3& v) {
-    return vec3(t*v.e[0], t*v.e[1], t*v.e[2]);
+template <typename T>
+inline basic_vec3<T> operator*(typename basic_vec3<T>::value_type t, const basic_vec3<T>& v) {
+#ifdef RT_SIMD_VEC3
+    return basic_vec3<T>(basic_vec3<T>::splat(t) * v.lanes());
+#else
+    return basic_vec3<T>(t*v.e[0], t*v.e[1], t*v.e[2]);
+#endif
 }
 
-inline vec3 operator*(const vec3& v, double t) {
+template <typename T>
+inline basic_vec3<T> operator*(const basic_vec3<T>& v, typename basic_vec3<T>::value_type t) {
     return t*v;
 }
 
-inline vec3 operator/( const vec3& v, double t) {
+template <typename T>
+inline basic_vec3<T> operator/( const basic_vec3<T>& v, typename basic_vec3<T>::value_type t) {
     return (1/t)*v;
 }
 
-inline double dot(const vec3& u, const vec3& v) {
+template <typename T>
+inline T dot(const basic_vec3<T>& u, const basic_vec3<T>& v) {
+#ifdef RT_SIMD_VEC3
+    return (u.lanes() * v.lanes()).sum3();
+#else
     return u.e[0]*v.e[0] + u.e[1]*v.e[1] + u.e[2]*v.e[2];
+#endif
 }
 
-inline vec3 cross(const vec3& u, const vec3& v) {
-    return vec3(u.e[1]*v.e[2] - u.e[2]*v.e[1],
-                u.e[2]*v.e[0] - u.e[0]*v.e[2],
-                u.e[0]*v.e[1] - u.e[1]*v.e[0]);
+template <typename T>
+inline basic_vec3<T> cross(const basic_vec3<T>& u, const basic_vec3<T>& v) {
+#ifdef RT_SIMD_VEC3
+    // (y, z, x) * (z, x, y) - (z, x, y) * (y, z, x), each component as in the scalar form.
+    auto a = u.lanes(), b = v.lanes();
+    return basic_vec3<T>(a.yzx() * b.zxy() - a.zxy() * b.yzx());
+#else
+    return basic_vec3<T>(u.e[1]*v.e[2] - u.e[2]*v.e[1],
+                         u.e[2]*v.e[0] - u.e[0]*v.e[2],
+                         u.e[0]*v.e[1] - u.e[1]*v.e[0]);
+#endif
 }
 
-inline vec3 unit_vector(const vec3& v) {
+template <typename T>
+inline basic_vec3<T> unit_vector(const basic_vec3<T>& v) {
     return v / v.length();
 }
 
+template <typename T>
+inline basic_vec3<T> abs(const basic_vec3<T>& v) {
+    return basic_vec3<T>(std::fabs(v.e[0]), std::fabs(v.e[1]), std::fabs(v.e[2]));
+}
+
 inline vec3 random_in_unit_disk() {
     while (true) {
         auto p = vec3(random_double(-1,1), random_double(-1,1), 0);
@@ -123,10 +216,10 @@ inline vec3 random_in_unit_disk() {
 
 inline vec3 random_unit_vector() {
     while (true) {
-        auto p = vec3::random(-1,1);
+        auto p = basic_vec3<double>::random(-1,1);
         auto lensq = p.length_squared();
         if (1e-160 < lensq && lensq <= 1)
-            return p/sqrt(lensq);
+            return vec3(p/sqrt(lensq));
     }
 }
 
@@ -163,5 +256,3 @@ inline vec3 refract(const vec3& uv, const vec3& n, double etai_over_etat) {
 }
 
 #endif //VEC3_H
-
-
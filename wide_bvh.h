@@ -0,0 +1,320 @@
+#ifndef WIDE_BVH_H
+#define WIDE_BVH_H
+
+#include "linear_bvh.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+// A 4- or 8-wide BVH made by collapsing the binary tree from bvh_builder. Each node stores
+// the bounds of all its children in structure-of-arrays form, so one ray is tested against
+// every child with a handful of SIMD min/max operations instead of W separate box tests.
+
+template <int W>
+struct alignas(32) wide_bvh_node {
+    static_assert(W == 4 || W == 8, "wide_bvh_node supports 4 or 8 children");
+
+    float min_x[W], min_y[W], min_z[W];
+    float max_x[W], max_y[W], max_z[W];
+    uint32_t child[W];          // Interior child: node index. Leaf child: first primitive.
+    uint16_t prim_count[W];     // 0 for interior children
+    uint32_t child_count;       // Children occupy slots [0, child_count)
+};
+
+// Single-precision copy of a ray for the child box tests. The origin is kept rounded both
+// ways: a box's near planes are measured from the origin rounded up and its far planes from
+// the origin rounded down, which can only move each slab's entry earlier and its exit later
+// whichever way the ray points. The exit is then widened by 2 gamma(3), as in PBRT, to cover
+// the rounding of the subtraction, the product and the reciprocal.
+struct wide_bvh_ray {
+    float orig_up[3];
+    float orig_down[3];
+    float inv_dir[3];
+
+    explicit wide_bvh_ray(const ray& r) {
+        const auto& o = r.origin();
+        const auto& inv = r.inv_direction();
+        for (int axis = 0; axis < 3; axis++) {
+            orig_up[axis] = round_up(o[axis]);
+            orig_down[axis] = round_down(o[axis]);
+            inv_dir[axis] = float(inv[axis]);
+        }
+    }
+
+    static float round_down(double x) {
+        auto f = float(x);
+        return (double(f) > x) ? std::nextafter(f, -std::numeric_limits<float>::infinity()) : f;
+    }
+
+    static float round_up(double x) {
+        auto f = float(x);
+        return (double(f) < x) ? std::nextafter(f, std::numeric_limits<float>::infinity()) : f;
+    }
+
+    static constexpr float far_scale = 1 + 2 * (3 * FLT_EPSILON / 2 / (1 - 3 * FLT_EPSILON / 2));
+};
+
+template <int W>
+inline uint32_t wide_box_hit(const wide_bvh_node<W>& node, const wide_bvh_ray& r,
+                             float t_min, float t_max, float t_near[W]) {
+    // Slab test of the ray against all W child boxes. Returns a bit per child hit and the
+    // entry distance of each child in t_near.
+
+    uint32_t mask = 0;
+
+#if defined(__AVX__)
+    if constexpr (W == 8) {
+        auto slab = [&](const float* lo, const float* hi, int axis, __m256& near, __m256& far) {
+            const __m256 inv = _mm256_set1_ps(r.inv_dir[axis]);
+            const __m256 t0 = _mm256_mul_ps(
+                _mm256_sub_ps(_mm256_load_ps(lo), _mm256_set1_ps(r.orig_up[axis])), inv);
+            const __m256 t1 = _mm256_mul_ps(
+                _mm256_sub_ps(_mm256_load_ps(hi), _mm256_set1_ps(r.orig_down[axis])), inv);
+            near = _mm256_max_ps(near, _mm256_min_ps(t0, t1));
+            far = _mm256_min_ps(far, _mm256_max_ps(t0, t1));
+        };
+
+        __m256 near = _mm256_set1_ps(t_min);
+        __m256 far = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+        slab(node.min_x, node.max_x, 0, near, far);
+        slab(node.min_y, node.max_y, 1, near, far);
+        slab(node.min_z, node.max_z, 2, near, far);
+        far = _mm256_min_ps(_mm256_mul_ps(far, _mm256_set1_ps(wide_bvh_ray::far_scale)),
+                            _mm256_set1_ps(t_max));
+
+        _mm256_storeu_ps(t_near, near);
+        mask = uint32_t(_mm256_movemask_ps(_mm256_cmp_ps(near, far, _CMP_LE_OQ)));
+        return mask & ((1u << node.child_count) - 1);
+    }
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+    if constexpr (W == 4) {
+        auto slab = [&](const float* lo, const float* hi, int axis, __m128& near, __m128& far) {
+            const __m128 inv = _mm_set1_ps(r.inv_dir[axis]);
+            const __m128 t0 = _mm_mul_ps(
+                _mm_sub_ps(_mm_load_ps(lo), _mm_set1_ps(r.orig_up[axis])), inv);
+            const __m128 t1 = _mm_mul_ps(
+                _mm_sub_ps(_mm_load_ps(hi), _mm_set1_ps(r.orig_down[axis])), inv);
+            near = _mm_max_ps(near, _mm_min_ps(t0, t1));
+            far = _mm_min_ps(far, _mm_max_ps(t0, t1));
+        };
+
+        __m128 near = _mm_set1_ps(t_min);
+        __m128 far = _mm_set1_ps(std::numeric_limits<float>::infinity());
+        slab(node.min_x, node.max_x, 0, near, far);
+        slab(node.min_y, node.max_y, 1, near, far);
+        slab(node.min_z, node.max_z, 2, near, far);
+        far = _mm_min_ps(_mm_mul_ps(far, _mm_set1_ps(wide_bvh_ray::far_scale)),
+                         _mm_set1_ps(t_max));
+
+        _mm_storeu_ps(t_near, near);
+        mask = uint32_t(_mm_movemask_ps(_mm_cmple_ps(near, far)));
+        return mask & ((1u << node.child_count) - 1);
+    }
+#endif
+
+    const float* lo[3] = { node.min_x, node.min_y, node.min_z };
+    const float* hi[3] = { node.max_x, node.max_y, node.max_z };
+
+    for (int k = 0; k < W; k++) {
+        auto near = t_min;
+        auto far = std::numeric_limits<float>::infinity();
+        for (int axis = 0; axis < 3; axis++) {
+            auto t0 = (lo[axis][k] - r.orig_up[axis]) * r.inv_dir[axis];
+            auto t1 = (hi[axis][k] - r.orig_down[axis]) * r.inv_dir[axis];
+            if (t0 > t1) std::swap(t0, t1);
+            near = t0 > near ? t0 : near;
+            far = t1 < far ? t1 : far;
+        }
+        far = std::min(far * wide_bvh_ray::far_scale, t_max);
+        t_near[k] = near;
+        mask |= uint32_t(near <= far) << k;
+    }
+
+    return mask & ((1u << node.child_count) - 1);
+}
+
+template <int W>
+class wide_bvh : public hittable {
+  public:
+    wide_bvh(const hittable_list& list, const bvh_build_options& options = {}) {
+        for (const auto& object : list.objects)
+            flatten_hittables(object, objects);
+
+        std::vector<aabb> prim_bounds;
+        prim_bounds.reserve(objects.size());
+        bbox = aabb::empty;
+        for (const auto& object : objects) {
+            prim_bounds.push_back(object->bounding_box());
+            bbox = aabb(bbox, prim_bounds.back());
+        }
+
+        std::vector<linear_bvh_node> binary;
+        std::vector<uint32_t> order;
+        bvh_builder::build(prim_bounds, options, binary, order);
+
+        primitives.reserve(order.size());
+        for (auto index : order)
+            primitives.push_back(objects[index].get());
+
+        if (!binary.empty()) {
+            nodes.reserve(binary.size() / (W - 1) + 1);
+            collapse(binary, 0);
+        }
+    }
+
+    // There is no packet traversal: packets of camera rays use hittable's hit_packet, which
+    // traces each lane through hit(). linear_bvh::hit_packet is the packet path.
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        if (nodes.empty())
+            return false;
+
+        const wide_bvh_ray fr(r);
+
+        struct entry {
+            uint32_t index;
+            uint32_t prim_count;
+            float t_near;
+        };
+
+        entry stack[linear_bvh_max_depth * W];
+        int stack_size = 0;
+        stack[stack_size++] = { 0, 0, float(ray_t.min) };
+
+        bool hit_anything = false;
+
+        while (stack_size > 0) {
+            auto e = stack[--stack_size];
+            if (e.t_near > float_t_max(ray_t.max))
+                continue;
+
+            if (e.prim_count > 0) {
+                for (uint32_t i = e.index; i < e.index + e.prim_count; i++) {
+                    if (primitives[i]->hit(r, ray_t, rec)) {
+                        hit_anything = true;
+                        ray_t.max = rec.t;
+                    }
+                }
+                continue;
+            }
+
+            const auto& node = nodes[e.index];
+            alignas(32) float t_near[W];
+            auto mask = wide_box_hit(node, fr, float_t_min(ray_t.min), float_t_max(ray_t.max),
+                                     t_near);
+
+            // Push the children hit far to near so the nearest is popped first.
+            int first = stack_size;
+            for (int k = 0; k < W; k++) {
+                if (!((mask >> k) & 1))
+                    continue;
+                entry child = { node.child[k], node.prim_count[k], t_near[k] };
+                int slot = stack_size++;
+                while (slot > first && stack[slot - 1].t_near < child.t_near) {
+                    stack[slot] = stack[slot - 1];
+                    slot--;
+                }
+                stack[slot] = child;
+            }
+        }
+
+        return hit_anything;
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    size_t node_count() const { return nodes.size(); }
+
+  private:
+    std::vector<shared_ptr<hittable>> objects;  // Owns the primitives
+    std::vector<const hittable*> primitives;    // Leaf order; leaves index into this array
+    std::vector<wide_bvh_node<W>> nodes;
+    aabb bbox;
+
+    // The ray interval is rounded outward to single precision for the box tests too.
+    static float float_t_max(double t) {
+        return float(t) * wide_bvh_ray::far_scale;
+    }
+
+    static float float_t_min(double t) {
+        auto f = float(t);
+        return (double(f) > t) ? std::nextafter(f, -FLT_MAX) : f;
+    }
+
+    uint32_t collapse(const std::vector<linear_bvh_node>& binary, uint32_t root) {
+        // Pull up to W descendants of a binary node into one wide node, always opening the
+        // interior child with the largest surface area, since it is the most likely to be hit.
+        auto node_index = uint32_t(nodes.size());
+        nodes.emplace_back();
+
+        std::vector<uint32_t> children;
+        if (binary[root].is_leaf()) {
+            children.push_back(root);
+        } else {
+            children.push_back(root + 1);
+            children.push_back(binary[root].offset);
+        }
+
+        while (children.size() < size_t(W)) {
+            int best = -1;
+            double best_area = -1;
+            for (size_t k = 0; k < children.size(); k++) {
+                const auto& child = binary[children[k]];
+                if (child.is_leaf())
+                    continue;
+                auto area = surface_area(child);
+                if (area > best_area) {
+                    best_area = area;
+                    best = int(k);
+                }
+            }
+            if (best < 0)
+                break;
+
+            auto opened = children[best];
+            children[best] = opened + 1;
+            children.push_back(binary[opened].offset);
+        }
+
+        wide_bvh_node<W> wide = {};
+        wide.child_count = uint32_t(children.size());
+        for (size_t k = 0; k < children.size(); k++) {
+            const auto& child = binary[children[k]];
+            wide.min_x[k] = child.bounds_min[0];
+            wide.min_y[k] = child.bounds_min[1];
+            wide.min_z[k] = child.bounds_min[2];
+            wide.max_x[k] = child.bounds_max[0];
+            wide.max_y[k] = child.bounds_max[1];
+            wide.max_z[k] = child.bounds_max[2];
+            wide.prim_count[k] = child.prim_count;
+            wide.child[k] = child.is_leaf() ? child.offset : 0;
+        }
+
+        for (size_t k = 0; k < children.size(); k++) {
+            if (!binary[children[k]].is_leaf())
+                wide.child[k] = collapse(binary, children[k]);
+        }
+
+        nodes[node_index] = wide;
+        return node_index;
+    }
+
+    static double surface_area(const linear_bvh_node& node) {
+        double dx = node.bounds_max[0] - node.bounds_min[0];
+        double dy = node.bounds_max[1] - node.bounds_min[1];
+        double dz = node.bounds_max[2] - node.bounds_min[2];
+        return 2 * (dx*dy + dy*dz + dz*dx);
+    }
+};
+
+using bvh4 = wide_bvh<4>;
+using bvh8 = wide_bvh<8>;
+
+#endif //WIDE_BVH_H